@@ -0,0 +1,481 @@
+#include "u.h"
+#include "lib.h"
+#include "kern/dat.h"
+#include "kern/fns.h"
+#include "user.h"
+
+#define	Image	IMAGE
+#include <draw.h>
+#include <memdraw.h>
+#include <cursor.h>
+#include "kern/screen.h"
+#include "args.h"
+
+/*
+ * Replay a log made with $DRAWTERM_DRAWLOG (see kern/devdraw.c)
+ * through devdraw on an in-memory screen of the same size and
+ * report the time spent on each kind of message.  Each message is
+ * written to its client's data file on its own, except that a run
+ * of 't' and 'o' messages is written together, as devdraw draws
+ * the run only when it ends; the run's time is shared among them.
+ * With -b each write is replayed whole, as it was made, and only
+ * the total is reported.  The results go to standard output one
+ * message kind per line, tab separated, under a header line
+ * starting with #.
+ */
+
+char	*argv0;
+Memimage	*gscreen;
+
+typedef struct Rclient Rclient;
+struct Rclient
+{
+	int	id;		/* in the log */
+	int	ctl;
+	int	data;
+	Rclient	*next;
+};
+
+typedef struct Stat Stat;
+struct Stat
+{
+	vlong	n;
+	vlong	bytes;
+	vlong	ns;
+	vlong	err;
+};
+
+static Rectangle	screenr;
+static ulong		screenchan;
+static Rclient	*clients;
+static Stat	stats[256];
+static vlong	nflushrect;
+static int	whole;
+
+/*
+ * The screen, kept in memory.
+ */
+void
+screeninit(void)
+{
+	memimageinit();
+	gscreen = allocmemimage(screenr, screenchan);
+	if(gscreen == nil)
+		panic("screeninit: %r");
+	gscreen->clipr = screenr;
+	memfillcolor(gscreen, DBlack);
+}
+
+Memdata*
+attachscreen(Rectangle *r, ulong *chan, int *depth, int *width, int *softscreen)
+{
+	*r = gscreen->clipr;
+	*chan = gscreen->chan;
+	*depth = gscreen->depth;
+	*width = gscreen->width;
+	*softscreen = 1;
+
+	gscreen->data->ref++;
+	return gscreen->data;
+}
+
+void
+flushmemscreenrects(Rectangle *r, int n)
+{
+	USED(r);
+	nflushrect += n;
+}
+
+void
+flushmemscreen(Rectangle r)
+{
+	flushmemscreenrects(&r, 1);
+}
+
+void
+getcolor(ulong i, ulong *r, ulong *g, ulong *b)
+{
+	ulong v;
+
+	v = cmap2rgb(i);
+	*r = (v>>16)&0xFF;
+	*g = (v>>8)&0xFF;
+	*b = v&0xFF;
+}
+
+void
+setcolor(ulong i, ulong r, ulong g, ulong b)
+{
+	/* no-op */
+}
+
+void
+setcursor(void)
+{
+}
+
+void
+mouseset(Point xy)
+{
+	USED(xy);
+}
+
+char*
+clipread(void)
+{
+	return nil;
+}
+
+int
+clipwrite(char *buf)
+{
+	USED(buf);
+	return 0;
+}
+
+long
+latin1(Rune *k, int n)
+{
+	USED(k);
+	USED(n);
+	return -1;
+}
+
+static Rclient*
+getclient(int id)
+{
+	Rclient *c;
+	char buf[12*12+1], *p;
+
+	for(c=clients; c; c=c->next)
+		if(c->id == id)
+			return c;
+	c = mallocz(sizeof *c, 1);
+	if(c == nil)
+		sysfatal("out of memory");
+	c->id = id;
+	if((c->ctl = open("#i/draw/new", ORDWR)) < 0)
+		sysfatal("open #i/draw/new: %r");
+	if(read(c->ctl, buf, 12*12) < 12*12)
+		sysfatal("read #i/draw/new: %r");
+	buf[12*12] = 0;
+	p = smprint("#i/draw/%d/data", atoi(buf));
+	if((c->data = open(p, ORDWR)) < 0)
+		sysfatal("open %s: %r", p);
+	free(p);
+	c->next = clients;
+	clients = c;
+	return c;
+}
+
+static void
+delclient(int id)
+{
+	Rclient *c, **l;
+
+	for(l=&clients; (c = *l) != nil; l=&c->next)
+		if(c->id == id){
+			*l = c->next;
+			close(c->data);
+			close(c->ctl);
+			free(c);
+			return;
+		}
+}
+
+/*
+ * The depth of image id, asked of devdraw as a client would.
+ */
+static int
+imagedepth(Rclient *c, uchar *id)
+{
+	char buf[12*12+1], *f[12];
+
+	if(write(c->ctl, id, 4) != 4 || read(c->ctl, buf, 12*12) < 12*12)
+		return -1;
+	buf[12*12] = 0;
+	if(tokenize(buf, f, nelem(f)) < 3)
+		return -1;
+	return chantodepth(strtochan(f[2]));
+}
+
+/*
+ * Bytes of compressed data making up n bytes of image.
+ */
+static int
+clen(uchar *a, uchar *ea, int n)
+{
+	uchar *u;
+	int c;
+
+	for(u=a; n>0 && u<ea; ){
+		c = *u++;
+		if(c >= 128){
+			u += c-128+1;
+			n -= c-128+1;
+		}else{
+			u++;
+			n -= (c>>2)+3;
+		}
+	}
+	if(u > ea)
+		return ea-a;
+	return u-a;
+}
+
+static int
+coords(uchar *a, uchar *ea, int n)
+{
+	uchar *u;
+
+	for(u=a; n>0 && u<ea; n--)
+		u += (*u & 0x80) ? 3 : 1;
+	if(u > ea)
+		return ea-a;
+	return u-a;
+}
+
+/*
+ * The length of the message at a, or all of what is left
+ * if it cannot be told.
+ */
+static int
+msglen(Rclient *c, uchar *a, int n)
+{
+	Rectangle r;
+	int m, d;
+
+	m = n;
+	switch(*a){
+	case 'a':	m = 70; break;
+	case 'A':	m = 14; break;
+	case 'b':	m = 51; break;
+	case 'c':	m = 22; break;
+	case 'd':	m = 45; break;
+	case 'D':	m = 2; break;
+	case 'e':
+	case 'E':	m = 45; break;
+	case 'f':
+	case 'F':	m = 5; break;
+	case 'i':	m = 10; break;
+	case 'l':	m = 37; break;
+	case 'L':	m = 45; break;
+	case 'o':	m = 21; break;
+	case 'O':	m = 2; break;
+	case 'r':	m = 21; break;
+	case 'S':	m = 9; break;
+	case 'v':	m = 1; break;
+	case 'n':
+		if(n >= 6)
+			m = 6+a[5];
+		break;
+	case 'N':
+		if(n >= 7)
+			m = 7+a[6];
+		break;
+	case 's':
+		if(n >= 47)
+			m = 47+2*BGSHORT(a+45);
+		break;
+	case 'x':
+		if(n >= 47)
+			m = 59+2*BGSHORT(a+45);
+		break;
+	case 't':
+		if(n >= 4)
+			m = 4+4*BGSHORT(a+2);
+		break;
+	case 'p':
+	case 'P':
+		if(n >= 31)
+			m = 31+coords(a+31, a+n, 2*(BGSHORT(a+5)+1));
+		break;
+	case 'y':
+	case 'Y':
+		if(n < 21 || (d = imagedepth(c, a+1)) <= 0)
+			break;
+		r.min.x = BGLONG(a+5);
+		r.min.y = BGLONG(a+9);
+		r.max.x = BGLONG(a+13);
+		r.max.y = BGLONG(a+17);
+		if(badrect(r))
+			break;
+		m = bytesperline(r, d)*Dy(r);
+		if(*a == 'Y')
+			m = clen(a+21, a+n, m);
+		m += 21;
+		break;
+	}
+	if(m > n)
+		m = n;
+	return m;
+}
+
+static void
+replay(Rclient *c, uchar *a, int n)
+{
+	Stat *s;
+	vlong t;
+	int i, j, k, l, m, e;
+
+	if(whole){
+		t = osnsec();
+		e = write(c->data, a, n) != n;
+		stats[0].ns += osnsec()-t;
+		stats[0].n++;
+		stats[0].bytes += n;
+		stats[0].err += e;
+		return;
+	}
+	for(i=0; i<n; i+=m){
+		m = msglen(c, a+i, n-i);
+		k = 1;
+		if(a[i]=='t' || a[i]=='o')
+			while(i+m < n && (a[i+m]=='t' || a[i+m]=='o')){
+				m += msglen(c, a+i+m, n-i-m);
+				k++;
+			}
+		t = osnsec();
+		e = write(c->data, a+i, m) != m;
+		t = osnsec()-t;
+		for(j=0; j<m; j+=l){
+			l = k==1 ? m : msglen(c, a+i+j, m-j);
+			s = &stats[a[i+j]];
+			s->n++;
+			s->bytes += l;
+			s->ns += t/k;
+			s->err += e;
+		}
+	}
+}
+
+static void
+report(void)
+{
+	Stat *s, tot;
+	int i;
+
+	print("#op\tcount\tbytes\terrors\tms\tus/op\n");
+	memset(&tot, 0, sizeof tot);
+	for(i=0; i<nelem(stats); i++){
+		s = &stats[i];
+		if(s->n == 0)
+			continue;
+		if(i == 0)
+			print("write");
+		else
+			print("%c", i);
+		print("\t%lld\t%lld\t%lld\t%.3f\t%.3f\n", s->n, s->bytes, s->err,
+			s->ns/1e6, s->ns/1e3/s->n);
+		tot.n += s->n;
+		tot.bytes += s->bytes;
+		tot.err += s->err;
+		tot.ns += s->ns;
+	}
+	print("total\t%lld\t%lld\t%lld\t%.3f\t%.3f\n", tot.n, tot.bytes, tot.err,
+		tot.ns/1e6, tot.n ? tot.ns/1e3/tot.n : 0.0);
+	print("#flushed rects %lld\n", nflushrect);
+}
+
+static uchar*
+readlog(char *file, long *np)
+{
+	FILE *f;
+	uchar *a;
+	long n, na;
+	size_t m;
+
+	if((f = fopen(file, "rb")) == nil)
+		sysfatal("open %s: %s", file, strerror(errno));
+	n = 0;
+	na = 1<<20;
+	if((a = malloc(na)) == nil)
+		sysfatal("out of memory");
+	while((m = fread(a+n, 1, na-n, f)) > 0){
+		n += m;
+		if(n == na){
+			na *= 2;
+			if((a = realloc(a, na)) == nil)
+				sysfatal("out of memory");
+		}
+	}
+	fclose(f);
+	*np = n;
+	return a;
+}
+
+void
+usage(void)
+{
+	fprint(2, "usage: drawreplay [-b] log\n");
+	exits("usage");
+}
+
+int
+main(int argc, char **argv)
+{
+	uchar *a, *p, *ep;
+	long n, m;
+
+	ARGBEGIN{
+	case 'b':
+		whole = 1;
+		break;
+	default:
+		usage();
+	}ARGEND
+	if(argc != 1)
+		usage();
+
+	/* draw synchronously and do not log the replay */
+	setenv("DRAWTERM_FLUSHHZ", "0", 0);
+	unsetenv("DRAWTERM_DRAWLOG");
+
+	eve = "drawreplay";
+	osinit();
+	procinit0();
+	printinit();
+	chandevreset();
+	chandevinit();
+	quotefmtinstall();
+	if(bind("#c", "/dev", MBEFORE) < 0)
+		panic("bind #c: %r");
+	if(open("/dev/cons", OREAD) != 0)
+		panic("open0: %r");
+	if(open("/dev/cons", OWRITE) != 1)
+		panic("open1: %r");
+	if(open("/dev/cons", OWRITE) != 2)
+		panic("open2: %r");
+
+	a = readlog(argv[0], &n);
+	ep = a+n;
+	if(n < 21 || a[0] != 's')
+		sysfatal("%s: not a draw log", argv[0]);
+	screenr = Rect(BGLONG(a+1), BGLONG(a+5), BGLONG(a+9), BGLONG(a+13));
+	screenchan = BGLONG(a+17);
+
+	for(p=a+21; p<ep; ){
+		switch(*p){
+		case 'w':
+			if(ep-p < 13)
+				sysfatal("%s: short write record", argv[0]);
+			m = BGLONG(p+9);
+			if(m < 0 || m > ep-p-13)
+				sysfatal("%s: short write record", argv[0]);
+			replay(getclient(BGLONG(p+1)), p+13, m);
+			p += 13+m;
+			break;
+		case 'c':
+			if(ep-p < 5)
+				sysfatal("%s: short close record", argv[0]);
+			delclient(BGLONG(p+1));
+			p += 5;
+			break;
+		default:
+			sysfatal("%s: bad record %#.2ux", argv[0], *p);
+		}
+	}
+	report();
+	exits(nil);
+	return 0;
+}
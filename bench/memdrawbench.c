@@ -0,0 +1,711 @@
+#include <u.h>
+#include <libc.h>
+#include <draw.h>
+#include <memdraw.h>
+#include <memlayer.h>
+#include "../args.h"
+
+/*
+ * Time the libmemdraw and libmemlayer entry points over a matrix
+ * of channel formats, sizes, replication and ops.  Each case is
+ * repeated until it has run for the time budget; the results go
+ * to standard output one case per line, tab separated, under a
+ * header line starting with #.  A case is named by its first
+ * field and the ones after it up to the size, and runs are
+ * reproducible: images are filled from a fixed seed.
+ */
+
+char	*argv0;
+vlong	benchnsec(void);
+
+enum
+{
+	Nsize	= 3,
+};
+
+typedef struct Case Case;
+struct Case
+{
+	char	*bench;
+	char	*op;
+	ulong	dst;
+	ulong	src;
+	ulong	mask;		/* 0 for none */
+	char	*repl;
+	Point	size;
+};
+
+static Point sizes[Nsize] = {
+	{16, 16},
+	{256, 256},
+	{1024, 768},
+};
+
+static int	budget = 50;	/* milliseconds per case */
+static char	*filter;
+static int	nsize = Nsize;
+static ulong	seed;
+
+static ulong
+rnd(void)
+{
+	seed = seed*1103515245 + 12345;
+	return seed>>8;
+}
+
+static void
+fillrand(Memimage *i)
+{
+	uchar *p, *ep;
+
+	p = byteaddr(i, i->r.min);
+	ep = p + sizeof(ulong)*i->width*Dy(i->r);
+	for(; p < ep; p++)
+		*p = rnd();
+	/* keep alpha images premultiplied */
+	if(i->chan == ARGB32 || i->chan == RGBA32 || i->chan == ABGR32)
+		memimagedraw(i, i->r, memopaque, ZP, nil, ZP, DoverS);
+}
+
+static Memimage*
+image(Rectangle r, ulong chan)
+{
+	Memimage *i;
+
+	if((i = allocmemimage(r, chan)) == nil)
+		sysfatal("allocmemimage %R %ux: %r", r, chan);
+	fillrand(i);
+	return i;
+}
+
+static char*
+channame(ulong chan)
+{
+	static char buf[4][16];
+	static int n;
+	char *s;
+
+	if(chan == 0)
+		return "-";
+	s = buf[n++ % nelem(buf)];
+	if(chantostr(s, chan) == nil)
+		return "?";
+	return s;
+}
+
+static int
+skip(Case *c)
+{
+	char buf[256];
+
+	if(filter == nil)
+		return 0;
+	snprint(buf, sizeof buf, "%s %s %s %s %s %s %dx%d", c->bench, c->op,
+		channame(c->dst), channame(c->src), channame(c->mask), c->repl,
+		c->size.x, c->size.y);
+	return strstr(buf, filter) == nil;
+}
+
+/*
+ * Run fn(a) until the budget is spent and print the result;
+ * npix is the number of pixels one call touches.
+ */
+static void
+run(Case *c, void (*fn)(void*), void *a, vlong npix)
+{
+	vlong t0, t, n, lim;
+
+	fn(a);	/* warm up */
+	lim = (vlong)budget*1000000;
+	n = 0;
+	t0 = benchnsec();
+	do{
+		fn(a);
+		n++;
+	}while((t = benchnsec()-t0) < lim);
+	print("%s\t%s\t%s\t%s\t%s\t%s\t%d\t%d\t%lld\t%lld\t%.2f\n",
+		c->bench, c->op, channame(c->dst), channame(c->src), channame(c->mask),
+		c->repl, c->size.x, c->size.y, n, t/n,
+		(double)npix*n*1000.0/t);
+}
+
+/*
+ * memimagedraw
+ */
+typedef struct Draw Draw;
+struct Draw
+{
+	Memimage	*dst;
+	Memimage	*src;
+	Memimage	*mask;
+	Rectangle	r;
+	int	op;
+};
+
+static void
+dodraw(void *a)
+{
+	Draw *d;
+
+	d = a;
+	memimagedraw(d->dst, d->r, d->src, ZP, d->mask, ZP, d->op);
+}
+
+static struct {
+	ulong	dst;
+	ulong	src;
+} drawchans[] = {
+	XRGB32,	XRGB32,
+	XRGB32,	ARGB32,
+	XRGB32,	RGB24,
+	XRGB32,	GREY8,
+	XRGB32,	CMAP8,
+	ARGB32,	ARGB32,
+	ARGB32,	XRGB32,
+	RGB24,	RGB24,
+	RGB16,	XRGB32,
+	GREY8,	GREY8,
+	CMAP8,	CMAP8,
+	GREY1,	GREY1,
+};
+
+static ulong drawmasks[] = { 0, GREY1, GREY8, ARGB32 };
+static char *drawrepls[] = { "none", "src1x1", "src16x16", "mask16x16" };
+static struct {
+	int	op;
+	char	*name;
+} drawops[] = {
+	S,	"S",
+	SoverD,	"SoverD",
+};
+
+static void
+benchdraw(void)
+{
+	Case c;
+	Draw d;
+	Rectangle r, sr, mr;
+	int i, j, k, l, z;
+
+	c.bench = "draw";
+	for(z=0; z<nsize; z++)
+	for(i=0; i<nelem(drawchans); i++)
+	for(j=0; j<nelem(drawmasks); j++)
+	for(k=0; k<nelem(drawrepls); k++)
+	for(l=0; l<nelem(drawops); l++){
+		c.op = drawops[l].name;
+		c.dst = drawchans[i].dst;
+		c.src = drawchans[i].src;
+		c.mask = drawmasks[j];
+		c.repl = drawrepls[k];
+		c.size = sizes[z];
+		if(c.mask == 0 && strcmp(c.repl, "mask16x16") == 0)
+			continue;
+		if(skip(&c))
+			continue;
+		seed = 1;
+		r = Rpt(ZP, c.size);
+		sr = mr = r;
+		if(strcmp(c.repl, "src1x1") == 0)
+			sr = Rect(0, 0, 1, 1);
+		else if(strcmp(c.repl, "src16x16") == 0)
+			sr = Rect(0, 0, 16, 16);
+		else if(strcmp(c.repl, "mask16x16") == 0)
+			mr = Rect(0, 0, 16, 16);
+		d.dst = image(r, c.dst);
+		d.src = image(sr, c.src);
+		d.mask = c.mask ? image(mr, c.mask) : nil;
+		if(!eqrect(sr, r)){
+			d.src->flags |= Frepl;
+			d.src->clipr = Rect(-0x3FFFFFF, -0x3FFFFFF, 0x3FFFFFF, 0x3FFFFFF);
+		}
+		if(d.mask != nil && !eqrect(mr, r)){
+			d.mask->flags |= Frepl;
+			d.mask->clipr = Rect(-0x3FFFFFF, -0x3FFFFFF, 0x3FFFFFF, 0x3FFFFFF);
+		}
+		d.r = r;
+		d.op = drawops[l].op;
+		run(&c, dodraw, &d, (vlong)Dx(r)*Dy(r));
+		freememimage(d.dst);
+		freememimage(d.src);
+		if(d.mask != nil)
+			freememimage(d.mask);
+	}
+}
+
+/*
+ * Geometry: polygons, ellipses, lines and strings are drawn
+ * with a replicated 1x1 source, as libdraw programs do.
+ */
+typedef struct Geom Geom;
+struct Geom
+{
+	Memimage	*dst;
+	Memimage	*src;
+	Memsubfont	*font;
+	Point	size;
+	int	kind;
+	int	arg;
+};
+
+enum
+{
+	Gpoly,
+	Gfillpoly,
+	Gellipse,
+	Gfillellipse,
+	Gline,
+	Gstring,
+};
+
+static char *geomnames[] = {
+[Gpoly]		"poly",
+[Gfillpoly]	"fillpoly",
+[Gellipse]	"ellipse",
+[Gfillellipse]	"fillellipse",
+[Gline]		"line",
+[Gstring]	"string",
+};
+
+static void
+dogeom(void *a)
+{
+	Geom *g;
+	Point p[32], c;
+	int i, rx, ry;
+
+	g = a;
+	c = divpt(g->size, 2);
+	rx = c.x-1;
+	ry = c.y-1;
+	switch(g->kind){
+	case Gpoly:
+	case Gfillpoly:
+		/* a star */
+		for(i=0; i<nelem(p); i++){
+			p[i].x = c.x + (i&1 ? rx/2 : rx)*cos(2*M_PI*i/nelem(p));
+			p[i].y = c.y + (i&1 ? ry/2 : ry)*sin(2*M_PI*i/nelem(p));
+		}
+		if(g->kind == Gfillpoly)
+			memfillpoly(g->dst, p, nelem(p), ~0, g->src, ZP, SoverD);
+		else
+			mempoly(g->dst, p, nelem(p), Enddisc, Enddisc, g->arg, g->src, ZP, SoverD);
+		break;
+	case Gellipse:
+		memellipse(g->dst, c, rx, ry, g->arg, g->src, ZP, SoverD);
+		break;
+	case Gfillellipse:
+		memellipse(g->dst, c, rx, ry, -1, g->src, ZP, SoverD);
+		break;
+	case Gline:
+		for(i=0; i<16; i++)
+			memline(g->dst, Pt(0, i*g->size.y/16), Pt(g->size.x-1, g->size.y-1-i*g->size.y/16),
+				Endsquare, Endsquare, g->arg, g->src, ZP, SoverD);
+		break;
+	case Gstring:
+		for(i=0; i+g->font->height <= g->size.y; i += g->font->height)
+			memimagestring(g->dst, Pt(0, i), g->src, ZP, g->font,
+				"The quick brown fox jumps over the lazy dog; 0123456789!");
+		break;
+	}
+}
+
+static void
+benchgeom(void)
+{
+	static ulong chans[] = { XRGB32, ARGB32, RGB16, GREY8, CMAP8, GREY1 };
+	static int widths[] = { 0, 3 };
+	char name[32];
+	Case c;
+	Geom g;
+	int i, k, w, z;
+
+	g.font = getmemdefont();
+	for(z=0; z<nsize; z++)
+	for(k=0; k<nelem(geomnames); k++)
+	for(w=0; w<nelem(widths); w++)
+	for(i=0; i<nelem(chans); i++){
+		if(w > 0 && (k == Gfillpoly || k == Gfillellipse || k == Gstring))
+			continue;
+		snprint(name, sizeof name, "w%d", widths[w]);
+		c.bench = geomnames[k];
+		c.op = k == Gfillpoly || k == Gfillellipse || k == Gstring ? "SoverD" : name;
+		c.dst = chans[i];
+		c.src = XRGB32;
+		c.mask = 0;
+		c.repl = "src1x1";
+		c.size = sizes[z];
+		if(skip(&c))
+			continue;
+		seed = 1;
+		g.dst = image(Rpt(ZP, c.size), c.dst);
+		g.src = image(Rect(0, 0, 1, 1), c.src);
+		g.src->flags |= Frepl;
+		g.src->clipr = Rect(-0x3FFFFFF, -0x3FFFFFF, 0x3FFFFFF, 0x3FFFFFF);
+		g.size = c.size;
+		g.kind = k;
+		g.arg = widths[w];
+		run(&c, dogeom, &g, (vlong)c.size.x*c.size.y);
+		freememimage(g.dst);
+		freememimage(g.src);
+	}
+}
+
+/*
+ * Image data in and out: unloadmemimage, loadmemimage,
+ * cloadmemimage on the compressed blocks writememimage
+ * makes, and writememimage itself at each effort.
+ */
+typedef struct Load Load;
+struct Load
+{
+	Memimage	*i;
+	uchar	*data;
+	int	ndata;
+	int	kind;
+	int	fd;
+	uchar	*blk[4096];	/* compressed blocks */
+	int	nblk[4096];
+	int	maxy[4096];
+	int	nb;
+};
+
+enum
+{
+	Lunload,
+	Lload,
+	Lcload,
+	Lwrite,
+};
+
+static void
+doload(void *a)
+{
+	Load *l;
+	int i, y;
+
+	l = a;
+	switch(l->kind){
+	case Lunload:
+		unloadmemimage(l->i, l->i->r, l->data, l->ndata);
+		break;
+	case Lload:
+		loadmemimage(l->i, l->i->r, l->data, l->ndata);
+		break;
+	case Lcload:
+		y = l->i->r.min.y;
+		for(i=0; i<l->nb; i++){
+			cloadmemimage(l->i, Rect(l->i->r.min.x, y, l->i->r.max.x, l->maxy[i]), l->blk[i], l->nblk[i]);
+			y = l->maxy[i];
+		}
+		break;
+	case Lwrite:
+		seek(l->fd, 0, 0);
+		writememimage(l->fd, l->i);
+		break;
+	}
+}
+
+/* a screen-like image: flat areas, edges and some text */
+static void
+fillscreen(Memimage *i)
+{
+	Memimage *c;
+	Rectangle r;
+	int n;
+
+	memfillcolor(i, DWhite);
+	c = allocmemimage(Rect(0, 0, 1, 1), XRGB32);
+	c->flags |= Frepl;
+	c->clipr = Rect(-0x3FFFFFF, -0x3FFFFFF, 0x3FFFFFF, 0x3FFFFFF);
+	for(n=0; n<16; n++){
+		memfillcolor(c, rnd()<<8 | 0xFF);
+		r.min = Pt(rnd()%Dx(i->r), rnd()%Dy(i->r));
+		r.max = addpt(r.min, Pt(rnd()%(Dx(i->r)/2+1), rnd()%(Dy(i->r)/2+1)));
+		memimagedraw(i, r, c, ZP, nil, ZP, S);
+		memimagestring(i, r.min, memblack, ZP, getmemdefont(), "lorem ipsum dolor sit amet");
+	}
+	freememimage(c);
+}
+
+static void
+splitblocks(Load *l, uchar *buf, int n)
+{
+	uchar *p, *ep;
+
+	p = buf + 11+5*12;
+	ep = buf + n;
+	for(l->nb = 0; p < ep && l->nb < nelem(l->blk); l->nb++){
+		l->maxy[l->nb] = atoi((char*)p);
+		l->nblk[l->nb] = atoi((char*)p+12);
+		l->blk[l->nb] = p+2*12;
+		p += 2*12 + l->nblk[l->nb];
+	}
+}
+
+static void
+benchload(void)
+{
+	static ulong chans[] = { XRGB32, RGB24, RGB16, GREY8, CMAP8, GREY1 };
+	static char *kinds[] = { "unload", "load", "cload", "write" };
+	static char *efforts[] = { "e1", "e4", "e9" };
+	char tmp[] = "/tmp/memdrawbenchXXXXXX";
+	uchar *buf;
+	Load *l;
+	Case c;
+	int i, k, e, z, n, ne;
+
+	l = mallocz(sizeof *l, 1);
+	if(l == nil || (l->fd = mkstemp(tmp)) < 0)
+		sysfatal("benchload: %r");
+	remove(tmp);
+	for(z=0; z<nsize; z++)
+	for(k=0; k<nelem(kinds); k++)
+	for(i=0; i<nelem(chans); i++){
+		ne = k == Lwrite || k == Lcload ? nelem(efforts) : 1;
+		for(e=0; e<ne; e++){
+			c.bench = kinds[k];
+			c.op = k == Lwrite || k == Lcload ? efforts[e] : "-";
+			c.dst = chans[i];
+			c.src = 0;
+			c.mask = 0;
+			c.repl = "none";
+			c.size = sizes[z];
+			if(skip(&c))
+				continue;
+			seed = 1;
+			l->i = image(Rpt(ZP, c.size), c.dst);
+			fillscreen(l->i);
+			l->ndata = Dy(l->i->r)*bytesperline(l->i->r, l->i->depth);
+			l->data = malloc(l->ndata);
+			if(l->data == nil)
+				sysfatal("malloc: %r");
+			unloadmemimage(l->i, l->i->r, l->data, l->ndata);
+			memwriteeffort = atoi(efforts[e]+1);
+			buf = nil;
+			if(k == Lcload){
+				seek(l->fd, 0, 0);
+				if(writememimage(l->fd, l->i) < 0)
+					sysfatal("writememimage: %r");
+				n = seek(l->fd, 0, 1);
+				buf = malloc(n);
+				seek(l->fd, 0, 0);
+				if(buf == nil || readn(l->fd, buf, n) != n)
+					sysfatal("reading back: %r");
+				splitblocks(l, buf, n);
+			}
+			l->kind = k;
+			run(&c, doload, l, (vlong)c.size.x*c.size.y);
+			free(buf);
+			free(l->data);
+			freememimage(l->i);
+		}
+	}
+	close(l->fd);
+	free(l);
+	memwriteeffort = 4;
+}
+
+/*
+ * memaffinewarp and memimagecorrelate
+ */
+typedef struct Warpcase Warpcase;
+struct Warpcase
+{
+	Memimage	*dst;
+	Memimage	*src;
+	Memimage	*k;
+	Warp	w;
+	int	smooth;
+};
+
+static void
+dowarp(void *a)
+{
+	Warpcase *w;
+
+	w = a;
+	memaffinewarp(w->dst, w->dst->r, w->src, ZP, w->w, w->smooth);
+}
+
+static void
+docorr(void *a)
+{
+	Warpcase *w;
+
+	w = a;
+	memimagecorrelate(w->dst, w->dst->r, w->src, ZP, w->k);
+}
+
+#define	fix(n)	((long)((n)*(1<<7) + ((n) < 0? -0.5: 0.5)))
+
+static void
+benchwarp(void)
+{
+	static ulong chans[] = { XRGB32, ARGB32, RGB24, GREY8 };
+	static char *ops[] = { "nearest", "bilinear", "box3", "box9", "sharpen" };
+	static double sharpen[] = { 0, -1, 0, -1, 5, -1, 0, -1, 0 };
+	double k[9*9];
+	Warpcase w;
+	Case c;
+	int i, j, o, z, n;
+
+	for(z=0; z<nsize; z++)
+	for(o=0; o<nelem(ops); o++)
+	for(i=0; i<nelem(chans); i++){
+		c.bench = o < 2 ? "warp" : "correlate";
+		c.op = ops[o];
+		c.dst = chans[i];
+		c.src = chans[i];
+		c.mask = 0;
+		c.repl = "none";
+		c.size = sizes[z];
+		if(skip(&c))
+			continue;
+		seed = 1;
+		w.dst = image(Rpt(ZP, c.size), c.dst);
+		w.src = image(Rpt(ZP, c.size), c.src);
+		w.k = nil;
+		/* rotate by 30° and scale by 1.2 about the centre */
+		w.w[0][0] = fix(cos(M_PI/6)/1.2); w.w[0][1] = fix(-sin(M_PI/6)/1.2);
+		w.w[1][0] = fix(sin(M_PI/6)/1.2); w.w[1][1] = fix(cos(M_PI/6)/1.2);
+		w.w[0][2] = fix(c.size.x/4); w.w[1][2] = fix(-c.size.y/8);
+		w.w[2][0] = w.w[2][1] = 0; w.w[2][2] = 1<<7;
+		w.smooth = o == 1;
+		if(o >= 2){
+			if(o == 4)
+				w.k = allocmemimagekernel(sharpen, 3, 3, 0);
+			else{
+				n = o == 2 ? 3 : 9;
+				for(j=0; j<n*n; j++)
+					k[j] = 1;
+				w.k = allocmemimagekernel(k, n, n, 0);
+			}
+			if(w.k == nil)
+				sysfatal("allocmemimagekernel: %r");
+		}
+		run(&c, o < 2 ? dowarp : docorr, &w, (vlong)c.size.x*c.size.y);
+		freememimage(w.dst);
+		freememimage(w.src);
+		if(w.k != nil)
+			freememimage(w.k);
+	}
+}
+
+/*
+ * Drawing through libmemlayer: a window half hidden behind
+ * another, so draws are split between screen and save image.
+ */
+typedef struct Layer Layer;
+struct Layer
+{
+	Memimage	*l;
+	Memimage	*src;
+};
+
+static void
+dolayer(void *a)
+{
+	Layer *l;
+
+	l = a;
+	memdraw(l->l, l->l->r, l->src, ZP, nil, ZP, SoverD);
+}
+
+static void
+benchlayer(void)
+{
+	static ulong chans[] = { XRGB32, RGB16, GREY8 };
+	Memscreen *s;
+	Memimage *front;
+	Layer l;
+	Case c;
+	Rectangle r;
+	int i, z;
+
+	for(z=0; z<nsize; z++)
+	for(i=0; i<nelem(chans); i++){
+		c.bench = "layerdraw";
+		c.op = "SoverD";
+		c.dst = chans[i];
+		c.src = ARGB32;
+		c.mask = 0;
+		c.repl = "none";
+		c.size = sizes[z];
+		if(skip(&c))
+			continue;
+		seed = 1;
+		s = mallocz(sizeof *s, 1);
+		s->image = image(Rpt(ZP, mulpt(c.size, 2)), c.dst);
+		s->fill = memwhite;
+		r = Rpt(ZP, c.size);
+		l.l = memlalloc(s, r, nil, nil, DWhite);
+		front = memlalloc(s, rectaddpt(r, divpt(c.size, 2)), nil, nil, DBlue);
+		if(l.l == nil || front == nil)
+			sysfatal("memlalloc: %r");
+		l.src = image(r, c.src);
+		run(&c, dolayer, &l, (vlong)c.size.x*c.size.y);
+		memldelete(front);
+		memldelete(l.l);
+		freememimage(l.src);
+		freememimage(s->image);
+		free(s);
+	}
+}
+
+static struct {
+	char	*name;
+	void	(*fn)(void);
+} benches[] = {
+	"draw",		benchdraw,
+	"geom",		benchgeom,
+	"load",		benchload,
+	"warp",		benchwarp,
+	"layer",	benchlayer,
+};
+
+static void
+usage(void)
+{
+	int i;
+
+	fprint(2, "usage: memdrawbench [-q] [-t ms] [-f filter] [group ...]\n");
+	fprint(2, "groups:");
+	for(i=0; i<nelem(benches); i++)
+		fprint(2, " %s", benches[i].name);
+	fprint(2, "\n");
+	exits("usage");
+}
+
+int
+main(int argc, char **argv)
+{
+	int i, j, any;
+
+	ARGBEGIN{
+	case 't':
+		budget = atoi(EARGF(usage()));
+		break;
+	case 'f':
+		filter = EARGF(usage());
+		break;
+	case 'q':
+		nsize = 2;	/* skip the largest size */
+		break;
+	default:
+		usage();
+	}ARGEND
+
+	memimageinit();
+	print("# bench\top\tdst\tsrc\tmask\trepl\tdx\tdy\titers\tns/op\tMpix/s\n");
+	for(i=0; i<nelem(benches); i++){
+		any = argc == 0;
+		for(j=0; j<argc; j++)
+			if(strcmp(argv[j], benches[i].name) == 0)
+				any = 1;
+		if(any)
+			benches[i].fn();
+	}
+	exits(nil);
+	return 0;
+}
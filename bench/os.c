@@ -0,0 +1,142 @@
+#include <u.h>
+#include <libc.h>
+
+/*
+ * The few system calls libc and libmemdraw make, done directly
+ * with POSIX instead of through the drawterm kernel.
+ */
+
+#undef read
+#undef write
+#undef open
+#undef close
+#undef seek
+#undef remove
+#undef getpid
+#undef nsec
+#undef sleep
+
+static char errbuf[ERRMAX];
+
+int
+print(char *fmt, ...)
+{
+	int n;
+	va_list arg;
+
+	va_start(arg, fmt);
+	n = vfprint(1, fmt, arg);
+	va_end(arg);
+	return n;
+}
+
+int
+iprint(char *fmt, ...)
+{
+	int n;
+	va_list arg;
+
+	va_start(arg, fmt);
+	n = vfprint(2, fmt, arg);
+	va_end(arg);
+	return n;
+}
+
+long
+sysread(int fd, void *a, long n)
+{
+	return read(fd, a, n);
+}
+
+long
+syswrite(int fd, void *a, long n)
+{
+	return write(fd, a, n);
+}
+
+int
+sysopen(char *name, int mode)
+{
+	return open(name, mode);
+}
+
+int
+sysclose(int fd)
+{
+	return close(fd);
+}
+
+vlong
+sysseek(int fd, vlong off, int whence)
+{
+	return lseek(fd, off, whence);
+}
+
+int
+sysremove(char *name)
+{
+	return unlink(name);
+}
+
+int
+sysgetpid(void)
+{
+	return getpid();
+}
+
+void
+osyield(void)
+{
+	usleep(0);
+}
+
+void
+osmsleep(int ms)
+{
+	usleep(ms*1000);
+}
+
+vlong
+benchnsec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (vlong)ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+void
+werrstr(char *f, ...)
+{
+	va_list arg;
+
+	va_start(arg, f);
+	vsnprint(errbuf, sizeof errbuf, f, arg);
+	va_end(arg);
+}
+
+int
+__errfmt(Fmt *f)
+{
+	if(errbuf[0] == 0 && errno != 0)
+		return fmtstrcpy(f, strerror(errno));
+	return fmtstrcpy(f, errbuf);
+}
+
+int
+errstr(char *buf, uint n)
+{
+	char tmp[ERRMAX];
+
+	memmove(tmp, errbuf, ERRMAX);
+	utfecpy(errbuf, errbuf+ERRMAX, buf);
+	utfecpy(buf, buf+n, tmp);
+	return strlen(buf);
+}
+
+int
+rerrstr(char *buf, uint n)
+{
+	utfecpy(buf, buf+n, errbuf);
+	return strlen(buf);
+}
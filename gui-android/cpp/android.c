@@ -165,6 +165,23 @@ flushmemscreen(Rectangle r)
 	return;
 }
 
+/*
+ * Each flush posts a frame, so post one for all of them.
+ */
+void
+flushmemscreenrects(Rectangle *r, int n)
+{
+	Rectangle bb;
+	int i;
+
+	if (n <= 0)
+		return;
+	bb = r[0];
+	for (i = 1; i < n; i++)
+		combinerect(&bb, r[i]);
+	flushmemscreen(bb);
+}
+
 void
 screeninit(void)
 {
@@ -405,6 +405,15 @@ flushmemscreen(Rectangle r)
 	}
 }
 
+void
+flushmemscreenrects(Rectangle *r, int n)
+{
+	int i;
+
+	for(i=0; i<n; i++)
+		flushmemscreen(r[i]);
+}
+
 void
 getcolor(ulong i, ulong *r, ulong *g, ulong *b)
 {
@@ -17,7 +17,6 @@
 #include <linux/input.h>
 
 uchar*		fbp;
-Memimage*	screenimage;
 Memimage*	backbuf;
 Rectangle	screenr;
 char*		snarfbuf;
@@ -76,6 +75,32 @@ int onevent(struct input_event*);
 void termctl(uint32_t o, int or);
 void ctrlc(int sig);
 
+/*
+ * If the frame buffer's lines are a whole number of words, gscreen
+ * is drawn straight into it: fbmd aliases the mapped frame buffer,
+ * and a flush has only to put the cursor back.  Otherwise gscreen
+ * is backbuf, and flushes copy it to the frame buffer.  While
+ * another console is showing, fbmd points at fbsave instead.
+ *
+ * Either way the cursor is drawn on the frame buffer with what it
+ * covers kept in curs.save.  In the direct case fbhwdraw takes it
+ * off before any draw that touches it, so gscreen never shows it.
+ * Moving the cursor redraws only its old and new rectangles, and
+ * redraws them once, through a scratch copy, if they overlap.
+ */
+static Memdata	fbmd;
+static uchar	*fbsave;
+
+static struct {
+	int		on;
+	Point		p;	/* of the cursor image */
+	Rectangle	r;	/* on the screen */
+	uchar		img[16*16*4];	/* in the frame buffer's format */
+	uchar		mask[16*16];
+	uchar		save[16*16*4];
+	uchar		tmp[32*32*4];
+} curs;
+
 void
 _fbput(Memimage *m, Rectangle r) {
 	int y;
@@ -88,6 +113,156 @@ _fbput(Memimage *m, Rectangle r) {
 	}
 }
 
+/*
+ * Copy r between rows of stride bytes at a, holding rectangle
+ * ar, and the tightly packed rows at b.  To a if toa is set.
+ */
+static void
+cursorcopy(uchar *a, int stride, Rectangle ar, Rectangle r, uchar *b, int toa)
+{
+	int y, n;
+
+	n = Dx(r) * depth;
+	a += (r.min.y - ar.min.y) * stride + (r.min.x - ar.min.x) * depth;
+	for (y = r.min.y; y < r.max.y; y++, a += stride, b += n) {
+		if (toa)
+			memcpy(a, b, n);
+		else
+			memcpy(b, a, n);
+	}
+}
+
+/*
+ * Save what is under the cursor and draw it there.
+ */
+static void
+cursorpaint(uchar *a, int stride, Rectangle ar)
+{
+	uchar *p, *m, *s;
+	int x, y, i;
+
+	cursorcopy(a, stride, ar, curs.r, curs.save, 0);
+	a += (curs.r.min.y - ar.min.y) * stride + (curs.r.min.x - ar.min.x) * depth;
+	for (y = curs.r.min.y; y < curs.r.max.y; y++, a += stride) {
+		i = (y - curs.p.y) * 16 + curs.r.min.x - curs.p.x;
+		m = curs.mask + i;
+		s = curs.img + i * depth;
+		p = a;
+		for (x = curs.r.min.x; x < curs.r.max.x; x++, m++, s += depth, p += depth)
+			if (*m)
+				memcpy(p, s, depth);
+	}
+}
+
+/*
+ * Put back what the cursor covers.
+ */
+static void
+cursoroff(void)
+{
+	if (!curs.on)
+		return;
+	curs.on = 0;
+	cursorcopy(fbmd.bdata, finfo.line_length, screenr, curs.r, curs.save, 1);
+}
+
+/*
+ * Draw the cursor at mousexy, taking it off where it was.
+ * If the two places overlap, both are done in curs.tmp and
+ * written to the frame buffer at once, so it does not flicker.
+ */
+static void
+cursoron(void)
+{
+	Rectangle r, u;
+
+	r.min = addpt(mousexy, cursor.offset);
+	r.max = addpt(r.min, Pt(16, 16));
+	curs.p = r.min;
+	if (rectclip(&r, screenr) == 0) {
+		cursoroff();
+		return;
+	}
+	if (!curs.on || !rectXrect(r, curs.r)) {
+		cursoroff();
+		curs.r = r;
+		cursorpaint(fbmd.bdata, finfo.line_length, screenr);
+		curs.on = 1;
+		return;
+	}
+	u = r;
+	combinerect(&u, curs.r);
+	cursorcopy(fbmd.bdata, finfo.line_length, screenr, u, curs.tmp, 0);
+	cursorcopy(curs.tmp, Dx(u) * depth, u, curs.r, curs.save, 1);
+	curs.r = r;
+	cursorpaint(curs.tmp, Dx(u) * depth, u);
+	cursorcopy(fbmd.bdata, finfo.line_length, screenr, u, curs.tmp, 1);
+}
+
+/*
+ * Turn the cursor bitmaps into pixels: white where clr is set,
+ * black where set is.
+ */
+static void
+cursorload(void)
+{
+	uchar *p;
+	int i, b;
+
+	for (i = 0; i < 16*16; i++) {
+		b = 128 >> (i % 8);
+		p = curs.img + i * depth;
+		curs.mask[i] = 1;
+		if (cursor.set[i/8] & b) {
+			memset(p, 0, depth);
+			if (depth == 4)
+				p[3] = 0xFF;
+		} else if (cursor.clr[i/8] & b)
+			memset(p, 0xFF, depth);
+		else
+			curs.mask[i] = 0;
+	}
+}
+
+static int
+fbtouched(Memimage *i, Rectangle r)
+{
+	return i != nil && i->data == &fbmd && curs.on && rectXrect(r, curs.r);
+}
+
+static int
+fbhwdraw(Memdrawparam *p)
+{
+	if (fbtouched(p->dst, p->r) || fbtouched(p->src, p->sr) || fbtouched(p->mask, p->mr))
+		cursoroff();
+	return 0;
+}
+
+/*
+ * Move gscreen off the frame buffer while another console
+ * shows, and back.  Called holding drawlock.
+ */
+static void
+fbhide(int h)
+{
+	size_t size;
+
+	size = vinfo.yres_virtual * finfo.line_length;
+	if (fbsave == nil) {
+		if (h)
+			curs.on = 0;
+		return;
+	}
+	if (h) {
+		memcpy(fbsave, fbp, size);
+		fbmd.bdata = fbsave;
+		cursoroff();
+	} else {
+		memcpy(fbp, fbsave, size);
+		fbmd.bdata = fbp;
+	}
+}
+
 Memimage*
 fbattach(int fbdevidx)
 {
@@ -132,7 +307,20 @@ fbattach(int fbdevidx)
 
 	screenr = r;
 
-	screenimage = allocmemimage(r, chan);
+	fbmd.bdata = fbp;
+	if (finfo.line_length % 4 == 0 && (fbsave = malloc(size)) != nil) {
+		fbmd.ref = 1;
+		fbmd.allocd = 0;
+		backbuf = allocmemimaged(r, chan, &fbmd);
+		if (backbuf != nil) {
+			backbuf->width = finfo.line_length / 4;
+			fbmd.imref = backbuf;
+			hwdrawhook = fbhwdraw;
+			return backbuf;
+		}
+		free(fbsave);
+		fbsave = nil;
+	}
 	backbuf = allocmemimage(r, chan);
 	return backbuf;
 
@@ -173,74 +361,34 @@ eventattach()
 }
 
 void
-flushmemscreen(Rectangle r)
+flushmemscreenrects(Rectangle *rr, int n)
 {
-	int x, y, i;
-	Point p;
-	long fbloc;
-	int x2, y2;
-
-	if (rectclip(&r, screenimage->r) == 0)
-		return;
-	if (Dx(r) == 0 || Dy(r) == 0)
-		return;
+	Rectangle r;
+	int i;
 
 	assert(!canqlock(&drawlock));
 
-	memimagedraw(screenimage, r, backbuf, r.min, nil, r.min, S);
-
 	if (hidden != 0)
 		return;
 
-	p = mousexy;
-
-	// draw cursor
-	for (x = 0; x < 16; x++) {
-		x2 = x + cursor.offset.x;
-
-		if ((p.x + x2) < 0)
-			continue;
-
-		if ((p.x + x2) >= screenimage->r.max.x)
-			break;
-
-		for (y = 0; y < 16; y++) {
-			y2 = y + cursor.offset.y;
-
-			if ((p.y + y2) < 0)
+	if (fbsave == nil) {
+		for (i = 0; i < n; i++) {
+			r = rr[i];
+			if (rectclip(&r, screenr) == 0)
 				continue;
-
-			if ((p.y + y2) >= screenimage->r.max.y)
-				break;
-
-			i = y * 2 + x / 8;
-			fbloc = ((p.y+y2) * screenimage->r.max.x + (p.x+x2)) * depth;
-
-			if (cursor.clr[i] & (128 >> (x % 8))) {
-				switch (depth) {
-				case 2:
-					*((uint16_t*)(screenimage->data->bdata + fbloc)) = 0xFFFF;
-					break;
-				case 4:
-					*((uint32_t*)(screenimage->data->bdata + fbloc)) = 0xFFFFFFFF;
-					break;
-				}
-			}
-
-			if (cursor.set[i] & (128 >> (x % 8))) {
-				switch (depth) {
-				case 2:
-					*((uint16_t*)(screenimage->data->bdata + fbloc)) = 0x0000;
-					break;
-				case 4:
-					*((uint32_t*)(screenimage->data->bdata + fbloc)) = 0xFF000000;
-					break;
-				}
-			}
+			if (curs.on && rectXrect(r, curs.r))
+				cursoroff();
+			_fbput(backbuf, r);
 		}
 	}
+	if (!curs.on)
+		cursoron();
+}
 
-	_fbput(screenimage, r);
+void
+flushmemscreen(Rectangle r)
+{
+	flushmemscreenrects(&r, 1);
 }
 
 static void
@@ -284,15 +432,21 @@ TOP:
 				panic("ttyfd read: %r");
 			buf[r] = '\0';
 			if (strcmp(buf, tty) == 0) {
-				hidden = 0;
 				printf("\e[?25l");
 				fflush(stdout);
 				qlock(&drawlock);
+				if (hidden)
+					fbhide(0);
+				hidden = 0;
 				flushmemscreen(gscreen->clipr);
 				qunlock(&drawlock);
-			}
-			else
+			} else {
+				qlock(&drawlock);
+				if (!hidden)
+					fbhide(1);
 				hidden = 1;
+				qunlock(&drawlock);
+			}
 			close(ttyfd);
 			ttyfd = open("/sys/class/tty/tty0/active", O_RDONLY);
 			if (ttyfd < 0)
@@ -389,6 +543,7 @@ screeninit(void)
 	kproc("fbdev", fbproc, nil);
 
 	qlock(&drawlock);
+	cursorload();
 	terminit();
 	flushmemscreen(gscreen->clipr);
 	qunlock(&drawlock);
@@ -468,7 +623,6 @@ ctrlc(int sig) {
 int
 onevent(struct input_event *data)
 {
-	Rectangle old, new;
 	ulong msec;
 	static int buttons;
 	static Point coord;
@@ -483,9 +637,6 @@ onevent(struct input_event *data)
 
 	msec = ticks();
 
-	old.min = mousexy;
-	old.max = addpt(old.min, Pt(16, 16));
-
 	buttons &= ~0x18;
 
 	switch(data->type) {
@@ -618,23 +769,18 @@ onevent(struct input_event *data)
 		return -1;
 	}
 
-	if (mousexy.x < screenimage->r.min.x)
-		mousexy.x = screenimage->r.min.x;
-	if (mousexy.y < screenimage->r.min.y)
-		mousexy.y = screenimage->r.min.y;
-	if (mousexy.x > screenimage->r.max.x)
-		mousexy.x = screenimage->r.max.x;
-	if (mousexy.y > screenimage->r.max.y)
-		mousexy.y = screenimage->r.max.y;
+	if (mousexy.x < screenr.min.x)
+		mousexy.x = screenr.min.x;
+	if (mousexy.y < screenr.min.y)
+		mousexy.y = screenr.min.y;
+	if (mousexy.x > screenr.max.x)
+		mousexy.x = screenr.max.x;
+	if (mousexy.y > screenr.max.y)
+		mousexy.y = screenr.max.y;
 	
-	new.min = mousexy;
-	new.max = addpt(new.min, Pt(16, 16)); // size of cursor bitmap
-
-	combinerect(&new, old);
-	new.min = subpt(new.min, Pt(16, 16)); // to encompass any cursor->offset
-
 	qlock(&drawlock);
-	flushmemscreen(new);
+	if (hidden == 0)
+		cursoron();
 	qunlock(&drawlock);
 
 	if ((msec - lastmsec) < 10)
@@ -653,7 +799,8 @@ mouseset(Point p)
 {
 	qlock(&drawlock);
 	mousexy = p;
-	flushmemscreen(screenr);
+	if (hidden == 0)
+		cursoron();
 	qunlock(&drawlock);
 }
 
@@ -661,7 +808,9 @@ void
 setcursor(void)
 {
 	qlock(&drawlock);
-	flushmemscreen(screenr);
+	cursorload();
+	if (hidden == 0)
+		cursoron();
 	qunlock(&drawlock);
 }
 
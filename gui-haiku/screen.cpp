@@ -300,6 +300,11 @@ void flushmemscreen(Rectangle r) {
   sApp->window->PostMessage(&message, sApp->view);
 }
 
+void flushmemscreenrects(Rectangle *r, int n) {
+  for (int i = 0; i < n; i++)
+    flushmemscreen(r[i]);
+}
+
 Memdata *attachscreen(Rectangle *r, ulong *chan, int *depth, int *width,
                       int *softscreen) {
   *r = gscreen->clipr;
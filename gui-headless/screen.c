@@ -0,0 +1,448 @@
+#include "u.h"
+#include "lib.h"
+#include "dat.h"
+#include "fns.h"
+#include "error.h"
+
+#include <draw.h>
+#include <memdraw.h>
+#include <keyboard.h>
+#include <cursor.h>
+#include "screen.h"
+
+/*
+ * A screen with no display: gscreen is kept in memory and
+ * flushes are only counted.  Input comes from the script in the
+ * host file (or pipe) $DRAWTERM_INPUT, one command per line:
+ *
+ *	type text	type text; \n, \t and \\ stand for themselves
+ *	key k		press and release key k
+ *	down k		press key k
+ *	up k		release key k
+ *	mouse x y [b]	move the mouse to x y with buttons b held
+ *	sleep ms	wait ms milliseconds
+ *	sync [ms]	wait until the screen has been flushed since the
+ *			last input, or ms milliseconds (default 1000)
+ *	hash		report a hash of the screen
+ *	dump file	write the screen to file as an uncompressed image
+ *	stats		report the counts of flushes and input and the
+ *			time from input to the flush after it
+ *	exit		exit drawterm
+ *
+ * A key is a single character, a number or one of the names in
+ * keyname.  Blank lines and lines starting with # are skipped.
+ * Reports go to standard error.  If $DRAWTERM_FRAMES names a host
+ * file, a line giving the flush number, the time in milliseconds
+ * and a hash of the screen is written to it after every flush.
+ * The screen is $DRAWTERM_SCREEN (WxH) pixels, 1024x768 unless set.
+ */
+
+Memimage	*gscreen;
+
+static Rectangle	screenr;
+static Point		mousexy;
+static char		*snarfbuf;
+static FILE		*frames;
+
+static struct {
+	ulong	flush;
+	uvlong	rects;
+	uvlong	pixels;
+	ulong	input;
+	ulong	mouseset;
+	ulong	setcursor;
+	int	pending;	/* input not yet followed by a flush */
+	vlong	t;		/* of the first such input */
+	ulong	nlat;
+	vlong	lat;
+	vlong	maxlat;
+} st;
+
+static struct {
+	char	*name;
+	Rune	r;
+} keyname[] = {
+	"esc",	Kesc,
+	"up",	Kup,
+	"down",	Kdown,
+	"left",	Kleft,
+	"right",	Kright,
+	"home",	Khome,
+	"end",	Kend,
+	"pgup",	Kpgup,
+	"pgdown",	Kpgdown,
+	"ins",	Kins,
+	"del",	Kdel,
+	"shift",	Kshift,
+	"ctl",	Kctl,
+	"alt",	Kalt,
+	"bs",	'\b',
+	"tab",	'\t',
+	"nl",	'\n',
+	"space",	' ',
+};
+
+/*
+ * Print to the host's standard error, not to /dev/cons.
+ */
+static void
+report(char *fmt, ...)
+{
+	char buf[256];
+	va_list arg;
+	int n;
+
+	va_start(arg, fmt);
+	n = vsnprint(buf, sizeof buf, fmt, arg);
+	va_end(arg);
+	write(2, buf, n);
+}
+
+static uvlong
+screenhash(void)
+{
+	uvlong h;
+	uchar *p;
+	int y, i, n;
+
+	h = 0xCBF29CE484222325ULL;
+	n = bytesperline(screenr, gscreen->depth);
+	for(y=screenr.min.y; y<screenr.max.y; y++){
+		p = byteaddr(gscreen, Pt(screenr.min.x, y));
+		for(i=0; i<n; i++)
+			h = (h ^ p[i]) * 0x100000001B3ULL;
+	}
+	return h;
+}
+
+void
+flushmemscreenrects(Rectangle *rr, int n)
+{
+	Rectangle r;
+	char buf[64];
+	vlong t;
+	int i;
+
+	assert(!canqlock(&drawlock));
+
+	st.flush++;
+	st.rects += n;
+	for(i=0; i<n; i++){
+		r = rr[i];
+		if(rectclip(&r, screenr))
+			st.pixels += (uvlong)Dx(r)*Dy(r);
+	}
+	if(st.pending){
+		st.pending = 0;
+		t = osnsec() - st.t;
+		st.nlat++;
+		st.lat += t;
+		if(t > st.maxlat)
+			st.maxlat = t;
+	}
+	if(frames != nil){
+		snprint(buf, sizeof buf, "%lud %lud %016llux\n", st.flush, ticks(), screenhash());
+		fputs(buf, frames);
+		fflush(frames);
+	}
+}
+
+void
+flushmemscreen(Rectangle r)
+{
+	flushmemscreenrects(&r, 1);
+}
+
+/*
+ * Note an input event.  The time to the next flush is its latency.
+ */
+static void
+input(void)
+{
+	qlock(&drawlock);
+	st.input++;
+	if(!st.pending){
+		st.pending = 1;
+		st.t = osnsec();
+	}
+	qunlock(&drawlock);
+}
+
+static Rune
+getkey(char *s)
+{
+	Rune r;
+	char *e;
+	int i;
+
+	for(i=0; i<nelem(keyname); i++)
+		if(strcmp(s, keyname[i].name) == 0)
+			return keyname[i].r;
+	if(utflen(s) == 1){
+		chartorune(&r, s);
+		return r;
+	}
+	r = strtoul(s, &e, 0);
+	if(*e != 0)
+		return 0;
+	return r;
+}
+
+static void
+type(char *s)
+{
+	Rune r;
+
+	while(*s != 0){
+		s += chartorune(&r, s);
+		if(r == '\\' && *s != 0){
+			s += chartorune(&r, s);
+			if(r == 'n')
+				r = '\n';
+			else if(r == 't')
+				r = '\t';
+		}
+		input();
+		kbdkey(r, 1);
+		kbdkey(r, 0);
+	}
+}
+
+static void
+dump(char *file)
+{
+	FILE *f;
+	uchar *p;
+	int y, n;
+	char buf[5*12+1], cbuf[12];
+
+	if((f = fopen(file, "wb")) == nil){
+		report("headless: create %s: %s\n", file, strerror(errno));
+		return;
+	}
+	qlock(&drawlock);
+	snprint(buf, sizeof buf, "%11s %11d %11d %11d %11d ",
+		chantostr(cbuf, gscreen->chan), screenr.min.x, screenr.min.y,
+		screenr.max.x, screenr.max.y);
+	fwrite(buf, 1, 5*12, f);
+	n = bytesperline(screenr, gscreen->depth);
+	for(y=screenr.min.y; y<screenr.max.y; y++){
+		p = byteaddr(gscreen, Pt(screenr.min.x, y));
+		fwrite(p, 1, n, f);
+	}
+	qunlock(&drawlock);
+	if(fclose(f) != 0)
+		report("headless: write %s: %s\n", file, strerror(errno));
+}
+
+static void
+stats(void)
+{
+	qlock(&drawlock);
+	report("flush %lud rects %llud pixels %llud input %lud mouseset %lud setcursor %lud latency %lud %.3f %.3f\n",
+		st.flush, st.rects, st.pixels, st.input, st.mouseset, st.setcursor,
+		st.nlat, st.nlat ? st.lat/1e6/st.nlat : 0.0, st.maxlat/1e6);
+	qunlock(&drawlock);
+}
+
+static void
+command(char *s)
+{
+	char *f[4], *arg;
+	int n, b, ms;
+	Rune r;
+
+	while(*s == ' ' || *s == '\t')
+		s++;
+	if(*s == 0 || *s == '#')
+		return;
+	arg = s + strcspn(s, " \t");
+	if(*arg != 0){
+		*arg++ = 0;
+		arg += strspn(arg, " \t");
+	}
+	if(strcmp(s, "type") == 0){
+		type(arg);
+		return;
+	}
+	if(strcmp(s, "dump") == 0){
+		dump(arg);
+		return;
+	}
+	n = tokenize(arg, f, nelem(f));
+	if(strcmp(s, "key") == 0 || strcmp(s, "down") == 0 || strcmp(s, "up") == 0){
+		if(n != 1 || (r = getkey(f[0])) == 0)
+			goto bad;
+		input();
+		if(strcmp(s, "up") != 0)
+			kbdkey(r, 1);
+		if(strcmp(s, "down") != 0)
+			kbdkey(r, 0);
+	}else if(strcmp(s, "mouse") == 0){
+		if(n != 2 && n != 3)
+			goto bad;
+		b = n == 3 ? atoi(f[2]) : 0;
+		input();
+		mousexy = Pt(atoi(f[0]), atoi(f[1]));
+		absmousetrack(mousexy.x, mousexy.y, b, ticks());
+	}else if(strcmp(s, "sleep") == 0){
+		if(n != 1)
+			goto bad;
+		osmsleep(atoi(f[0]));
+	}else if(strcmp(s, "sync") == 0){
+		ms = n > 0 ? atoi(f[0]) : 1000;
+		while(st.pending && ms-- > 0)
+			osmsleep(1);
+	}else if(strcmp(s, "hash") == 0){
+		qlock(&drawlock);
+		report("hash %016llux\n", screenhash());
+		qunlock(&drawlock);
+	}else if(strcmp(s, "stats") == 0)
+		stats();
+	else if(strcmp(s, "exit") == 0)
+		exit(0);
+	else
+		goto bad;
+	return;
+bad:
+	report("headless: bad command: %s %s\n", s, arg);
+}
+
+static void
+scriptproc(void *a)
+{
+	FILE *f;
+	char line[1024];
+	int n;
+
+	f = a;
+	while(fgets(line, sizeof line, f) != nil){
+		n = strlen(line);
+		if(n > 0 && line[n-1] == '\n')
+			line[n-1] = 0;
+		command(line);
+	}
+	fclose(f);
+}
+
+void
+screensize(Rectangle r, ulong chan)
+{
+	Memimage *i;
+
+	if((i = allocmemimage(r, chan)) == nil)
+		return;
+	if(gscreen != nil)
+		freememimage(gscreen);
+	gscreen = i;
+	gscreen->clipr = ZR;
+}
+
+void
+screeninit(void)
+{
+	char *s, *e;
+	FILE *f;
+	int x, y;
+
+	x = 1024;
+	y = 768;
+	if((s = getenv("DRAWTERM_SCREEN")) != nil){
+		x = strtol(s, &e, 10);
+		if(*e == 'x')
+			y = strtol(e+1, nil, 10);
+		if(x <= 0 || y <= 0)
+			panic("bad $DRAWTERM_SCREEN %s", s);
+	}
+	screenr = Rect(0, 0, x, y);
+
+	memimageinit();
+	screensize(screenr, XRGB32);
+	if(gscreen == nil)
+		panic("screensize failed");
+	gscreen->clipr = screenr;
+
+	if((s = getenv("DRAWTERM_FRAMES")) != nil && *s != 0)
+		if((frames = fopen(s, "w")) == nil)
+			panic("create %s: %s", s, strerror(errno));
+
+	qlock(&drawlock);
+	terminit();
+	flushmemscreen(gscreen->clipr);
+	qunlock(&drawlock);
+
+	if((s = getenv("DRAWTERM_INPUT")) != nil && *s != 0){
+		if((f = fopen(s, "r")) == nil)
+			panic("open %s: %s", s, strerror(errno));
+		kproc("script", scriptproc, f);
+	}
+}
+
+Memdata*
+attachscreen(Rectangle *r, ulong *chan, int *depth, int *width, int *softscreen)
+{
+	*r = gscreen->clipr;
+	*chan = gscreen->chan;
+	*depth = gscreen->depth;
+	*width = gscreen->width;
+	*softscreen = 1;
+
+	gscreen->data->ref++;
+	return gscreen->data;
+}
+
+void
+getcolor(ulong i, ulong *r, ulong *g, ulong *b)
+{
+	ulong v;
+
+	v = cmap2rgb(i);
+	*r = (v>>16)&0xFF;
+	*g = (v>>8)&0xFF;
+	*b = v&0xFF;
+}
+
+void
+setcolor(ulong i, ulong r, ulong g, ulong b)
+{
+	/* no-op */
+}
+
+void
+setcursor(void)
+{
+	qlock(&drawlock);
+	st.setcursor++;
+	qunlock(&drawlock);
+}
+
+void
+mouseset(Point xy)
+{
+	qlock(&drawlock);
+	st.mouseset++;
+	mousexy = xy;
+	qunlock(&drawlock);
+}
+
+char*
+clipread(void)
+{
+	if(snarfbuf)
+		return strdup(snarfbuf);
+	return nil;
+}
+
+int
+clipwrite(char *buf)
+{
+	free(snarfbuf);
+	snarfbuf = strdup(buf);
+	return 0;
+}
+
+void
+guimain(void)
+{
+	cpubody();
+}
@@ -110,11 +110,10 @@ attachscreen(Rectangle *r, ulong *chan, int *depth, int *width, int *softscreen)
 	return gscreen->data;
 }
 
-void
-flushmemscreen(Rectangle r)
+static void
+putrect(HDC hdc, Rectangle r)
 {
 	int dx, dy;
-	HDC hdc;
 
 	/*
 	 * Sometimes we do get rectangles that are off the
@@ -123,12 +122,6 @@ flushmemscreen(Rectangle r)
 	 */
 	if(rectclip(&r, gscreen->clipr) == 0)
 		return;
-	
-	lock(&gdilock);
-
-	hdc = GetDC(window);
-	SelectPalette(hdc, palette, 0);
-	RealizePalette(hdc);
 
 	dx = r.max.x - r.min.x;
 	dy = r.max.y - r.min.y;
@@ -143,6 +136,22 @@ flushmemscreen(Rectangle r)
 		0, dy,
 		byteaddr(gscreen, Pt(0, r.min.y)), bmi,
 		dibtype);
+}
+
+void
+flushmemscreenrects(Rectangle *r, int n)
+{
+	HDC hdc;
+	int i;
+
+	lock(&gdilock);
+
+	hdc = GetDC(window);
+	SelectPalette(hdc, palette, 0);
+	RealizePalette(hdc);
+
+	for(i=0; i<n; i++)
+		putrect(hdc, r[i]);
 
 	ReleaseDC(window, hdc);
 
@@ -151,6 +160,12 @@ flushmemscreen(Rectangle r)
 	unlock(&gdilock);
 }
 
+void
+flushmemscreen(Rectangle r)
+{
+	flushmemscreenrects(&r, 1);
+}
+
 static void
 winproc(void *a)
 {
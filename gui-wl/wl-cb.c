@@ -24,22 +24,6 @@
 #include "screen.h"
 #include "wl-inc.h"
 
-static const struct wl_callback_listener wl_surface_frame_listener;
-
-static void
-wl_surface_frame_done(void *data, struct wl_callback *cb, uint32_t time)
-{
-	Wlwin *wl;
-
-	wl = data;
-	wl_callback_destroy(cb);
-	cb = wl_surface_frame(wl->surface);
-	wl_callback_add_listener(cb, &wl_surface_frame_listener, wl);
-	qlock(&drawlock);
-	wlflush(wl);
-	qunlock(&drawlock);
-}
-
 static void
 keyboard_keymap(void *data, struct wl_keyboard *keyboard, uint32_t format, int32_t fd, uint32_t size)
 {
@@ -305,10 +289,6 @@ keyboard_modifiers (void *data, struct wl_keyboard *keyboard, uint32_t serial, u
 	xkb_state_update_mask(wl->xkb_state, mods_depressed, mods_latched, mods_locked, 0, 0, group);
 }
 
-static const struct wl_callback_listener wl_surface_frame_listener = {
-	.done = wl_surface_frame_done,
-};
-
 static struct wl_keyboard_listener keyboard_listener = {
 	.keymap = keyboard_keymap,
 	.enter = keyboard_enter,
@@ -747,7 +727,6 @@ void
 wlsetcb(Wlwin *wl)
 {
 	struct wl_registry *registry;
-	struct wl_callback *cb;
 
 	//Wayland doesn't do keyboard repeat, but also may
 	//not tell us what the user would like, so we
@@ -777,9 +756,6 @@ wlsetcb(Wlwin *wl)
 	wl_surface_commit(wl->surface);
 	wl_display_roundtrip(wl->display);
 
-	cb = wl_surface_frame(wl->surface);
-	wl_callback_add_listener(cb, &wl_surface_frame_listener, wl);
-
 	if(wl->data_device_manager != nil && wl->seat != nil){
 		wl->data_device = wl_data_device_manager_get_data_device(wl->data_device_manager, wl->seat);
 		wl_data_device_add_listener(wl->data_device, &data_device_listener, wl);
@@ -1,4 +1,6 @@
 typedef struct Wlwin Wlwin;
+typedef struct Wlbuf Wlbuf;
+typedef struct Wldmg Wldmg;
 typedef struct Clipboard Clipboard;
 
 /* The contents of the clipboard
@@ -25,6 +27,33 @@ struct Mouse {
 	ulong msec;
 };
 
+enum{
+	Nwlbuf = 3,	/* screen buffers */
+	Nwldmg = 16,	/* damage rectangles kept before merging */
+};
+
+/* Damage to the screen, as up to
+ * Nwldmg rectangles; past that they
+ * are merged into one. */
+struct Wldmg {
+	Rectangle r[Nwldmg];
+	int n;
+};
+
+/* One of the shm buffers the screen
+ * is shown from.  dmg is what has
+ * changed in gscreen since it was
+ * last shown; while busy the compositor
+ * may be reading it and it is not
+ * written. */
+struct Wlbuf {
+	struct wl_buffer *buf;
+	uchar *data;
+	int busy;
+	ulong seq;	/* when last committed */
+	Wldmg dmg;
+};
+
 enum{
 	Aunpress,
 	Apress,
@@ -39,8 +68,9 @@ struct Wlwin {
 	int mony;
 	Mouse mouse;
 	Clipboard clip;
-	Rectangle r;
-	int dirty;
+	Wldmg dmg;	/* since the last commit */
+	int framepending;
+	ulong seq;
 	int alt; /* Kalt state */
 
 	/* Wayland State */
@@ -56,7 +86,7 @@ struct Wlwin {
 	struct xdg_wm_base *xdg_wm_base;
 	struct xdg_toplevel *xdg_toplevel;
 	struct wl_shm_pool *pool;
-	struct wl_buffer *screenbuffer;
+	Wlbuf screen[Nwlbuf];
 	struct wl_buffer *cursorbuffer;
 	struct wl_shm *shm;
 	struct wl_seat *seat;
@@ -80,6 +110,8 @@ struct Wlwin {
 };
 
 void wlallocbuffer(Wlwin*);
+void wladddamage(Wldmg*, Rectangle);
+void wldamage(Wlwin*, Rectangle);
 void wlsetcb(Wlwin*);
 void wlsettitle(Wlwin*, char*);
 char* wlgetsnarf(Wlwin*);
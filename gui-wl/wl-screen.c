@@ -46,19 +46,90 @@ wlclose(Wlwin *wl)
 	exits(nil);
 }
 
-void
-wlflush(Wlwin *wl)
+/*
+ * The screen is shown from Nwlbuf shm buffers in turn.  Readying
+ * one copies only what has changed since it was last shown, and a
+ * buffer the compositor has not released is never written.  Each
+ * commit waits for the frame callback of the one before; damage
+ * that cannot be shown yet, for want of a frame or a free buffer,
+ * waits for the callback or a release, never the drawing.
+ */
+static const struct wl_callback_listener wl_surface_frame_listener;
+
+static void
+wl_surface_frame_done(void *data, struct wl_callback *cb, uint32_t time)
+{
+	Wlwin *wl;
+
+	wl = data;
+	wl_callback_destroy(cb);
+	qlock(&drawlock);
+	wl->framepending = 0;
+	wlflush(wl);
+	qunlock(&drawlock);
+}
+
+static const struct wl_callback_listener wl_surface_frame_listener = {
+	.done = wl_surface_frame_done,
+};
+
+static void
+wlcopy(Wlwin *wl, Wlbuf *b, Rectangle r)
 {
 	Point p;
 
-	wl_surface_attach(wl->surface, wl->screenbuffer, 0, 0);
-	if(wl->dirty){
-		p.x = wl->r.min.x;
-		for(p.y = wl->r.min.y; p.y < wl->r.max.y; p.y++)
-			memcpy(wl->shm_data+(p.y*wl->dx+p.x)*4, byteaddr(gscreen, p), Dx(wl->r)*4);
-		wl_surface_damage(wl->surface, p.x, wl->r.min.y, Dx(wl->r), Dy(wl->r));
-		wl->dirty = 0;
+	if(!rectclip(&r, gscreen->r) || !rectclip(&r, Rect(0, 0, wl->dx, wl->dy)))
+		return;
+	p.x = r.min.x;
+	for(p.y = r.min.y; p.y < r.max.y; p.y++)
+		memcpy(b->data+(p.y*wl->dx+p.x)*4, byteaddr(gscreen, p), Dx(r)*4);
+}
+
+void
+wldamage(Wlwin *wl, Rectangle r)
+{
+	int i;
+
+	wladddamage(&wl->dmg, r);
+	for(i = 0; i < Nwlbuf; i++)
+		wladddamage(&wl->screen[i].dmg, r);
+}
+
+/* Show the damage, if it can be now.
+ * Called holding drawlock. */
+void
+wlflush(Wlwin *wl)
+{
+	struct wl_callback *cb;
+	Wlbuf *b, *c;
+	int i;
+
+	if(wl->framepending || wl->dmg.n == 0 || gscreen == nil)
+		return;
+
+	/* the free buffer shown last has the least to copy */
+	b = nil;
+	for(i = 0; i < Nwlbuf; i++){
+		c = &wl->screen[i];
+		if(!c->busy && (b == nil || c->seq > b->seq))
+			b = c;
 	}
+	if(b == nil)
+		return;
+
+	for(i = 0; i < b->dmg.n; i++)
+		wlcopy(wl, b, b->dmg.r[i]);
+	b->dmg.n = 0;
+	wl_surface_attach(wl->surface, b->buf, 0, 0);
+	for(i = 0; i < wl->dmg.n; i++)
+		wl_surface_damage(wl->surface, wl->dmg.r[i].min.x, wl->dmg.r[i].min.y,
+			Dx(wl->dmg.r[i]), Dy(wl->dmg.r[i]));
+	wl->dmg.n = 0;
+	cb = wl_surface_frame(wl->surface);
+	wl_callback_add_listener(cb, &wl_surface_frame_listener, wl);
+	wl->framepending = 1;
+	b->busy = 1;
+	b->seq = ++wl->seq;
 	wl_surface_commit(wl->surface);
 }
 
@@ -69,10 +140,9 @@ wlresize(Wlwin *wl, int x, int y)
 {
 	Rectangle r;
 
+	qlock(&drawlock);
 	wl->dx = x;
 	wl->dy = y;
-
-	qlock(&drawlock);
 	wlallocbuffer(wl);
 	r = Rect(0, 0, wl->dx, wl->dy);
 	if(gscreen != nil)
@@ -84,8 +154,7 @@ wlresize(Wlwin *wl, int x, int y)
 	screenresize(r);
 
 	qlock(&drawlock);
-	wl->dirty = 1;
-	wl->r = r;
+	wldamage(wl, r);
 	wlflush(wl);
 	qunlock(&drawlock);
 }
@@ -119,6 +188,7 @@ wlattach(char *label)
 	r = Rect(0, 0, wl->dx, wl->dy);
 	gscreen = allocmemimage(r, XRGB32);
 	gscreen->clipr = r;
+	wldamage(wl, r);
 
 	wl->runing = 1;
 	kproc("wldispatch", dispatchproc, wl);
@@ -158,8 +228,17 @@ attachscreen(Rectangle *r, ulong *chan, int *depth, int *width, int *softscreen)
 void
 flushmemscreen(Rectangle r)
 {
-	gwin->dirty = 1;
-	gwin->r = r;
+	wldamage(gwin, r);
+	wlflush(gwin);
+}
+
+void
+flushmemscreenrects(Rectangle *r, int n)
+{
+	int i;
+
+	for(i = 0; i < n; i++)
+		wldamage(gwin, r[i]);
 	wlflush(gwin);
 }
 
@@ -43,54 +43,103 @@ wlcreateshm(off_t size)
 }
 
 void
-wlallocpool(Wlwin *wl)
+wlallocpool(Wlwin *wl, int size)
 {
-	int screensize, cursorsize;
-	int depth;
 	int fd;
 
 	if(wl->pool != nil)
 		wl_shm_pool_destroy(wl->pool);
 
-	depth = 4;
-	screensize = wl->monx * wl->mony * depth;
-	cursorsize = 16 * 16 * depth;
-
-	fd = wlcreateshm(screensize+cursorsize);
+	fd = wlcreateshm(size);
 	if(fd < 0)
 		panic("could not mk_shm_fd");
-	if(ftruncate(fd, screensize+cursorsize) < 0)
+	if(ftruncate(fd, size) < 0)
 		panic("could not ftruncate");
 
-	wl->shm_data = mmap(nil, screensize+cursorsize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	wl->shm_data = mmap(nil, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
 	if(wl->shm_data == MAP_FAILED)
 		panic("could not mmap shm_data");
 
-	wl->pool = wl_shm_create_pool(wl->shm, fd, screensize+cursorsize);
-	wl->poolsize = screensize+cursorsize;
+	wl->pool = wl_shm_create_pool(wl->shm, fd, size);
+	wl->poolsize = size;
 	close(fd);
 }
 
+static void
+wl_buffer_release(void *data, struct wl_buffer *buf)
+{
+	Wlwin *wl;
+	int i;
+
+	wl = data;
+	qlock(&drawlock);
+	for(i = 0; i < Nwlbuf; i++)
+		if(wl->screen[i].buf == buf)
+			wl->screen[i].busy = 0;
+	wlflush(wl);
+	qunlock(&drawlock);
+}
+
+static const struct wl_buffer_listener wl_buffer_listener = {
+	.release = wl_buffer_release,
+};
+
+/* Called holding drawlock, or before
+ * there is a gscreen. */
 void
 wlallocbuffer(Wlwin *wl)
 {
+	Wlbuf *b;
 	int depth;
-	int size;
+	int size, cursorsize, need;
+	int i;
 
 	depth = 4;
 	size = wl->dx * wl->dy * depth;
-	if(wl->pool == nil || size+(16*16*depth) > wl->poolsize)
-		wlallocpool(wl);
-
-	assert(size+(16*16*depth) <= wl->poolsize);
+	cursorsize = 16 * 16 * depth;
+	need = Nwlbuf*size + cursorsize;
+	if(wl->pool == nil || need > wl->poolsize){
+		if(wl->monx * wl->mony * depth > size)
+			need = Nwlbuf*wl->monx*wl->mony*depth + cursorsize;
+		wlallocpool(wl, need);
+	}
 
-	if(wl->screenbuffer != nil)
-		wl_buffer_destroy(wl->screenbuffer);
+	assert(Nwlbuf*size+cursorsize <= wl->poolsize);
+
+	for(i = 0; i < Nwlbuf; i++){
+		b = &wl->screen[i];
+		if(b->buf != nil)
+			wl_buffer_destroy(b->buf);
+		b->buf = wl_shm_pool_create_buffer(wl->pool, i*size, wl->dx, wl->dy, wl->dx*4, WL_SHM_FORMAT_XRGB8888);
+		wl_buffer_add_listener(b->buf, &wl_buffer_listener, wl);
+		b->data = (uchar*)wl->shm_data + i*size;
+		b->busy = 0;
+		b->dmg.n = 0;
+		wladddamage(&b->dmg, Rect(0, 0, wl->dx, wl->dy));
+	}
 	if(wl->cursorbuffer != nil)
 		wl_buffer_destroy(wl->cursorbuffer);
+	wl->cursorbuffer = wl_shm_pool_create_buffer(wl->pool, Nwlbuf*size, 16, 16, 16*4, WL_SHM_FORMAT_ARGB8888);
+}
 
-	wl->screenbuffer = wl_shm_pool_create_buffer(wl->pool, 0, wl->dx, wl->dy, wl->dx*4, WL_SHM_FORMAT_XRGB8888);
-	wl->cursorbuffer = wl_shm_pool_create_buffer(wl->pool, size, 16, 16, 16*4, WL_SHM_FORMAT_ARGB8888);
+void
+wladddamage(Wldmg *d, Rectangle r)
+{
+	int i;
+
+	if(Dx(r) <= 0 || Dy(r) <= 0)
+		return;
+	for(i = 0; i < d->n; i++)
+		if(rectinrect(r, d->r[i]))
+			return;
+	if(d->n == Nwldmg){
+		for(i = 1; i < d->n; i++)
+			combinerect(&d->r[0], d->r[i]);
+		combinerect(&d->r[0], r);
+		d->n = 1;
+		return;
+	}
+	d->r[d->n++] = r;
 }
 
 enum {
@@ -108,7 +157,7 @@ wldrawcursor(Wlwin *wl, Cursorinfo *c)
 	u32int *buf;
 	uint16_t clr[16], set[16];
 
-	buf = wl->shm_data+(wl->dx*wl->dy*4);
+	buf = wl->shm_data+(Nwlbuf*wl->dx*wl->dy*4);
 	for(i = 0, j = 0; i < 16; i++, j += 2){
 		clr[i] = c->clr[j]<<8 | c->clr[j+1];
 		set[i] = c->set[j]<<8 | c->set[j+1];
@@ -28,6 +28,9 @@ typedef struct Cursor Cursor;
 #include <X11/StringDefs.h>
 #include <X11/keysym.h>
 #include <X11/XKBlib.h>
+#include <X11/extensions/XShm.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
 #include "keysym2ucs.h"
 
 #undef	Font
@@ -50,6 +53,33 @@ static	Drawable	xscreenid;
 static	XImage*		xscreenimage;
 static	Visual		*xvis;
 
+/*
+ * On a local display with the MIT-SHM extension, the screen image
+ * lives in a shared memory segment that the X server reads itself:
+ * a flush is an XShmPutImage of each rectangle straight to the
+ * window, and the next flush first waits for the server to say it
+ * has finished, so puts do not queue up behind a busy server.
+ * Otherwise the rectangles go through the socket with XPutImage
+ * to the pixmap xscreenid and are copied from there to the window.
+ * A segment is kept until devdraw lets go of its Memdata too.
+ */
+typedef struct Xshmseg Xshmseg;
+struct Xshmseg
+{
+	XShmSegmentInfo	info;
+	Memdata		md;
+	Xshmseg		*next;
+};
+
+static struct
+{
+	int	ok;
+	int	event;		/* type of ShmCompletion */
+	int	pending;	/* a put has not completed */
+	int	err;
+	Xshmseg	*segs;
+} xshm;
+
 extern char		*geometry;	/* defined in main.c */
 
 #include "../glenda-t.xbm"
@@ -162,17 +192,168 @@ panicshutup(XDisplay *d)
 	return -1;
 }
 
+static int
+xshmerror(XDisplay *d, XErrorEvent *e)
+{
+	USED(d);
+	USED(e);
+	xshm.err = 1;
+	return 0;
+}
 
-void
-flushmemscreen(Rectangle r)
+static void
+xshminit(void)
+{
+	if(getenv("DRAWTERM_NOSHM") != nil)
+		return;
+	if(!XShmQueryExtension(xdisplay) || ImageByteOrder(xdisplay) != LSBFirst)
+		return;
+	xshm.event = XShmGetEventBase(xdisplay) + ShmCompletion;
+	xshm.ok = 1;
+}
+
+/*
+ * Like xallocmemimage, but in a segment shared with the server,
+ * or nil if that cannot be done, as when an 8-bit screen needs its
+ * colours mapped before they are sent; if the server cannot attach it
+ * (the display is remote, say), there will be no more tries.
+ */
+static Memimage*
+xshmallocmemimage(Rectangle r, ulong chan, XImage **X)
+{
+	XErrorHandler h;
+	Xshmseg *s;
+	Memimage *m;
+	XImage *xi;
+	int n;
+
+	if(!xshm.ok || chan != xscreenchan || chantodepth(chan) < 8 || !eqpt(r.min, ZP))
+		return nil;
+	/* the server would show the colour indices without plan9tox11 */
+	if(xtblbit && chan == CMAP8)
+		return nil;
+	s = mallocz(sizeof *s, 1);
+	if(s == nil)
+		return nil;
+	xi = XShmCreateImage(xdisplay, xvis, xscreendepth, ZPixmap, NULL, &s->info, Dx(r), Dy(r));
+	if(xi == nil){
+		free(s);
+		return nil;
+	}
+	n = xi->bytes_per_line;
+	if(n != wordsperline(r, chantodepth(chan))*sizeof(ulong)
+	|| (s->info.shmid = shmget(IPC_PRIVATE, n*Dy(r), IPC_CREAT|0600)) < 0){
+		XDestroyImage(xi);
+		free(s);
+		return nil;
+	}
+	s->info.shmaddr = shmat(s->info.shmid, NULL, 0);
+	shmctl(s->info.shmid, IPC_RMID, NULL);	/* gone once both detach */
+	if(s->info.shmaddr == (char*)-1){
+		XDestroyImage(xi);
+		free(s);
+		return nil;
+	}
+	s->info.readOnly = True;
+	xi->data = s->info.shmaddr;
+
+	xshm.err = 0;
+	h = XSetErrorHandler(xshmerror);
+	XShmAttach(xdisplay, &s->info);
+	XSync(xdisplay, False);
+	XSetErrorHandler(h);
+	if(xshm.err){
+		xshm.ok = 0;
+		xi->data = NULL;
+		XDestroyImage(xi);
+		shmdt(s->info.shmaddr);
+		free(s);
+		return nil;
+	}
+
+	s->md.bdata = (uchar*)s->info.shmaddr;
+	s->md.ref = 1;
+	s->md.allocd = 0;	/* freememimage leaves it to us */
+	m = allocmemimaged(r, chan, &s->md);
+	if(m == nil){
+		XShmDetach(xdisplay, &s->info);
+		xi->data = NULL;
+		XDestroyImage(xi);
+		shmdt(s->info.shmaddr);
+		free(s);
+		return nil;
+	}
+	s->md.imref = m;
+	s->next = xshm.segs;
+	xshm.segs = s;
+	*X = xi;
+	return m;
+}
+
+/*
+ * Free the segments no longer in use.
+ */
+static void
+xshmreap(void)
+{
+	Xshmseg *s, **l;
+
+	for(l=&xshm.segs; (s = *l) != nil; ){
+		if(s->md.ref > 0){
+			l = &s->next;
+			continue;
+		}
+		*l = s->next;
+		XShmDetach(xdisplay, &s->info);
+		shmdt(s->info.shmaddr);
+		free(s);
+	}
+}
+
+static Bool
+isshmdone(XDisplay *d, XEvent *e, XPointer a)
+{
+	USED(d);
+	USED(a);
+	return e->type == xshm.event;
+}
+
+/*
+ * Wait for the last put to complete.  The completion comes before
+ * the reply to XSync, so if it is not in by then (the put failed)
+ * it never will be.
+ */
+static void
+xshmwait(void)
+{
+	XEvent e;
+
+	if(!xshm.pending)
+		return;
+	if(!XCheckIfEvent(xdisplay, &e, isshmdone, NULL)){
+		XSync(xdisplay, False);
+		while(XCheckIfEvent(xdisplay, &e, isshmdone, NULL))
+			;
+	}
+	xshm.pending = 0;
+}
+
+static void
+xputrect(Rectangle r, int last)
 {
 	int x, y;
 	uchar *p;
 
-	assert(!canqlock(&drawlock));
 	if(rectclip(&r, gscreen->clipr) == 0)
 		return;
 
+	if(xscreenid == 0){
+		XShmPutImage(xdisplay, xdrawable, xgccopy, xscreenimage,
+			r.min.x, r.min.y, r.min.x, r.min.y, Dx(r), Dy(r), last);
+		xshm.pending |= last;
+		return;
+	}
+
 	if(xtblbit && gscreen->chan == CMAP8)
 		for(y=r.min.y; y<r.max.y; y++)
 			for(x=r.min.x, p=byteaddr(gscreen, Pt(x,y)); x<r.max.x; x++, p++)
@@ -186,9 +367,27 @@ flushmemscreen(Rectangle r)
 				*p = x11toplan9[*p];
 
 	XCopyArea(xdisplay, xscreenid, xdrawable, xgccopy, r.min.x, r.min.y, Dx(r), Dy(r), r.min.x, r.min.y);
+}
+
+void
+flushmemscreenrects(Rectangle *r, int n)
+{
+	int i;
+
+	assert(!canqlock(&drawlock));
+	xshmwait();
+	xshmreap();
+	for(i=0; i<n; i++)
+		xputrect(r[i], i == n-1);
 	XFlush(xdisplay);
 }
 
+void
+flushmemscreen(Rectangle r)
+{
+	flushmemscreenrects(&r, 1);
+}
+
 void
 screeninit(void)
 {
@@ -296,6 +495,7 @@ screeninit(void)
 		panic("unknown screen pixel format");
 
 	initmap(xdisplay, screen, xvis);
+	xshminit();
 
 	x = y = 0;
 	r = ZR;
@@ -389,30 +589,41 @@ screensize(Rectangle r, ulong chan)
 	XImage *xi;
 	GC gc;
 
-	pix = XCreatePixmap(xdisplay, xdrawable, Dx(r), Dy(r), xscreendepth);
-	if(pix == 0)
-		return;
-
-	gc = creategc(pix);
-	if(gc == NULL){
-		XFreePixmap(xdisplay, pix);
-		return;
+	pix = 0;
+	mi = nil;
+	if(xshm.ok && (gc = creategc(xdrawable)) != NULL){
+		xshmwait();
+		mi = xshmallocmemimage(r, chan, &xi);
+		if(mi == nil)
+			XFreeGC(xdisplay, gc);
 	}
-
-	mi = xallocmemimage(r, chan, pix, &xi);
 	if(mi == nil){
-		XFreeGC(xdisplay, gc);
-		XFreePixmap(xdisplay, pix);
-		return;
+		pix = XCreatePixmap(xdisplay, xdrawable, Dx(r), Dy(r), xscreendepth);
+		if(pix == 0)
+			return;
+
+		gc = creategc(pix);
+		if(gc == NULL){
+			XFreePixmap(xdisplay, pix);
+			return;
+		}
+
+		mi = xallocmemimage(r, chan, pix, &xi);
+		if(mi == nil){
+			XFreeGC(xdisplay, gc);
+			XFreePixmap(xdisplay, pix);
+			return;
+		}
 	}
 
 	if(gscreen != nil){
-		xscreenimage->data = NULL;	/* free'd by freememimage() */
+		xscreenimage->data = NULL;	/* free'd by freememimage() or xshmreap() */
 		XDestroyImage(xscreenimage);
 		freememimage(gscreen);
 
 		XFreeGC(xdisplay, xgccopy);
-		XFreePixmap(xdisplay, xscreenid);
+		if(xscreenid != 0)
+			XFreePixmap(xdisplay, xscreenid);
 	}
 
 	xscreenimage = xi;
@@ -4,6 +4,7 @@ typedef struct	Memsubfont Memsubfont;
 typedef struct	Memlayer Memlayer;
 typedef struct	Memcmap Memcmap;
 typedef struct	Memdrawparam	Memdrawparam;
+typedef struct	Memglyph	Memglyph;
 
 /*
  * Memdata is allocated from main pool, but .data from the image pool.
@@ -79,6 +80,17 @@ struct	Memsubfont
 	Memimage	*bits;		/* of font */
 };
 
+/*
+ * A glyph in a run drawn by memglyphs: its destination
+ * rectangle and the corresponding points in src and mask.
+ */
+struct	Memglyph
+{
+	Rectangle	r;
+	Point	sp;
+	Point	mp;
+};
+
 /*
  * Encapsulated parameters and information for sub-draw routines.
  */
@@ -105,6 +117,7 @@ struct	Memdrawparam
 	ulong sval;	/* if Simplesrc, the source pixel in src format */
 	ulong srgba;	/* sval in rgba */
 	ulong sdval;	/* sval in dst format */
+	void *fast;	/* the fast path kernel, if any */
 };
 
 /*
@@ -119,6 +132,7 @@ extern int	writememimage(int, Memimage*);
 extern void	freememimage(Memimage*);
 extern int		loadmemimage(Memimage*, Rectangle, uchar*, int);
 extern int		cloadmemimage(Memimage*, Rectangle, uchar*, int);
+extern int		cunloadmemimage(Memimage*, Rectangle, uchar*, int);
 extern int		unloadmemimage(Memimage*, Rectangle, uchar*, int);
 extern ulong*	wordaddr(Memimage*, Point);
 extern uchar*	byteaddr(Memimage*, Point);
@@ -137,9 +151,13 @@ extern void	memfillpoly(Memimage*, Point*, int, int, Memimage*, Point, int);
 extern void	_memfillpolysc(Memimage*, Point*, int, int, Memimage*, Point, int, int, int, int);
 extern void	memimagedraw(Memimage*, Rectangle, Memimage*, Point, Memimage*, Point, int);
 extern int	hwdraw(Memdrawparam*);
+extern int	(*hwdrawhook)(Memdrawparam*);
 extern void	memimageline(Memimage*, Point, Point, int, int, int, Memimage*, Point, int);
+extern void	_memfreebrush(void);
 extern void	_memimageline(Memimage*, Point, Point, int, int, int, Memimage*, Point, Rectangle, int);
 extern Point	memimagestring(Memimage*, Point, Memimage*, Point, Memsubfont*, char*);
+extern void	memglyphs(Memimage*, Memimage*, Memimage*, Memglyph*, int, int);
+extern void	_memimageglyphs(Memimage*, Rectangle, Point, Memimage*, Memimage*, Memglyph*, int, int);
 extern void	memellipse(Memimage*, Point, int, int, int, Memimage*, Point, int);
 extern void	memarc(Memimage*, Point, int, int, int, Memimage*, Point, int, int, int);
 extern Rectangle	memlinebbox(Point, Point, int, int, int);
@@ -172,3 +190,34 @@ extern	Memcmap	*memdefcmap;
  * Kernel interface
  */
 void		memimagemove(void*, void*);
+
+/*
+ * Parallel drawing.  If memdrawbands is set, alphadraw splits
+ * draws of at least memdrawbandpix pixels into as many as
+ * memdrawnband bands of scan lines and calls memdrawbands(f, a, n),
+ * which must run f(a, 0) through f(a, n-1), possibly in parallel,
+ * and return when all of them are done.
+ */
+extern	int	memdrawnband;
+extern	int	memdrawbandpix;
+extern	void	(*memdrawbands)(void (*)(void*, int), void*, int);
+
+/*
+ * Each thread that draws keeps its own scratch buffers;
+ * memdrawfreebuf frees the calling thread's before it exits.
+ */
+extern	void	memdrawfreebuf(void);
+
+/*
+ * If memdrawtrace is set, memimagedraw calls it after each draw
+ * with the name of the path that did the work: "hw", "opt",
+ * "char", "alpha", or the name of a fast-path kernel.
+ */
+extern	void	(*memdrawtrace)(Memdrawparam*, char*);
+
+/*
+ * How hard writememimage works at compressing: 0 writes
+ * the image uncompressed, 1 is fastest, 9 gives the smallest
+ * output.  Large images are compressed in strips with memdrawbands.
+ */
+extern	int	memwriteeffort;
@@ -4,6 +4,8 @@
 #endif
 
 typedef struct Memscreen Memscreen;
+typedef struct Memregion Memregion;
+typedef struct Memtile Memtile;
 typedef void (*Refreshfn)(Memimage*, Rectangle, void*);
 
 struct Memscreen
@@ -12,6 +14,31 @@ struct Memscreen
 	Memimage	*rearmost;	/* rearmost layer on screen */
 	Memimage	*image;		/* upon which all layers are drawn */
 	Memimage	*fill;			/* if non-zero, picture to use when repainting */
+	int		trans;		/* depth of memlbegin calls */
+};
+
+/*
+ * A region of the screen as y-x banded rectangles: sorted by min.y
+ * and then min.x, the rectangles of a band share their y extent and
+ * do not touch, and no two adjacent bands have the same x spans.
+ */
+struct Memregion
+{
+	Rectangle	*r;
+	int		nr;
+	int		nalloc;
+};
+
+/*
+ * A square of a layer's save area, made when first drawn on.
+ * Its coordinates are relative to the layer's screenr.min.
+ */
+struct Memtile
+{
+	Memimage	*i;		/* nil if unused or compressed */
+	uchar	*z;		/* compressed contents, for cloadmemimage */
+	int		nz;
+	ulong	used;	/* _memlsetclear count when last used */
 };
 
 struct Memlayer
@@ -22,9 +49,20 @@ struct Memlayer
 	Memimage	*front;	/* window in front of this one */
 	Memimage	*rear;	/* window behind this one*/
 	int		clear;	/* layer is fully visible */
-	Memimage	*save;	/* save area for obscured parts */
-	Refreshfn	refreshfn;		/* function to call to refresh obscured parts if save==nil */
+	int		saved;	/* obscured parts are kept in tiles */
+	Memtile	*tile;	/* save area for obscured parts, in rows of ntile */
+	int		ntile;
+	ulong	saveval;	/* colour of obscured parts with no tile */
+	Refreshfn	refreshfn;		/* function to call to refresh obscured parts if !saved */
 	void		*refreshptr;	/* argument to refreshfn */
+	Memregion	vis;		/* parts on the screen, if visok */
+	Memregion	obs;		/* parts in the save area, if obsok */
+	Rectangle	tscreenr;	/* screenr at memlbegin */
+	Memregion	tvis;		/* vis at memlbegin, then what memlcommit saves */
+	Memregion	texp;		/* what memlcommit exposes */
+	Rectangle	visscr;	/* screen clipr vis was made for */
+	int		visok;
+	int		obsok;
 };
 
 /*
@@ -49,5 +87,25 @@ int			memlsetrefresh(Memimage*, Refreshfn, void*);
 void			memlhide(Memimage*, Rectangle);
 void			memlexpose(Memimage*, Rectangle);
 void			_memlsetclear(Memscreen*);
+int			_memlvisible(Memimage*);
+void			_memlswapvis(Memimage*, Memimage*, Rectangle);
+void			_memlinvalvis(Memimage*);
+void			_memlfreevis(Memlayer*);
+int			_memlregion(Memregion*, Rectangle*, int);
+int			_memlregsub(Memregion*, Rectangle);
+void			_memlsaveop(void (*fn)(Memimage*, Rectangle, Rectangle, void*, int), Memlayer*, Rectangle, Rectangle, void*);
+Memimage*	_memltile(Memlayer*, Point, int);
+Memimage*	_memlread(Memimage*, Rectangle);
+void			_memltrimsave(Memscreen*);
+void			_memlfreesave(Memlayer*);
+void			_memlfill(Memimage*, Rectangle, ulong);
 int			memlorigin(Memimage*, Point, Point);
+int			memlbegin(Memscreen*);
+void			memlcommit(Memscreen*, void (*)(Rectangle, void*), void*);
 void			memlnorefresh(Memimage*, Rectangle, void*);
+
+/*
+ * Tiles of a save area not used in this many calls of _memlsetclear
+ * are compressed; 0 means never.
+ */
+extern int		memlzsave;
@@ -16,6 +16,7 @@ enum
 	Qtopdir		= 0,
 	Qnew,
 	Qwinname,
+	Qstats,
 	Q3rd,
 	Q2nd,
 	Qcolormap,
@@ -35,8 +36,7 @@ enum
 #define	CLIENTPATH(q)	((((ulong)q)&0x7FFFFFF0)>>QSHIFT)
 #define	CLIENT(q)	CLIENTPATH((q).path)
 
-#define	NHASH		(1<<5)
-#define	HASHMASK	(NHASH-1)
+#define	NHASH		(1<<5)	/* first size of a client's image table */
 #define	IOUNIT		(64*1024)
 
 typedef struct Client Client;
@@ -60,10 +60,20 @@ struct Draw
 	int		softscreen;
 };
 
+/*
+ * A client's images, screens and read data belong to whoever
+ * holds its lk.  drawlock guards the screen and everything
+ * clients share: windows, named images, public screens, the
+ * damage and the refresh lists.  Take lk before drawlock.
+ */
 struct Client
 {
 	Ref		r;
-	DImage*		dimage[NHASH];
+	QLock		lk;
+	DImage**	dimage;		/* by id, open addressed; nil if empty */
+	int		ndimage;	/* slots in dimage, a power of two */
+	int		nused;		/* images in dimage */
+	DImage*		lastdimage;	/* last image looked up */
 	CScreen*	cscreen;
 	Refresh*	refresh;
 	Rendez		refrend;
@@ -76,6 +86,7 @@ struct Client
 	int		refreshme;
 	int		infoid;
 	int		op;
+	int		drawlocked;	/* drawmesg holds drawlock */
 };
 
 struct Refresh
@@ -127,7 +138,6 @@ struct DImage
 	FChar*		fchar;
 	DScreen*	dscreen;	/* 0 if not a window */
 	DImage*		fromname;	/* image this one is derived from, by name */
-	DImage*		next;
 };
 
 struct CScreen
@@ -156,11 +166,113 @@ static	DImage*	screendimage;
 static	char	screenname[40];
 static	int	screennameid;
 
-static	Rectangle	flushrect;
-static	int		waste;
+enum
+{
+	Nflush=	16,	/* most rectangles of damage kept apart */
+	Nstatbuf=	8192,	/* big enough for every line of stats */
+};
+
+static	Rectangle	flushrect[Nflush];	/* disjoint damage not yet flushed */
+static	int		nflush;
+
+/*
+ * Damage is presented by flushproc at most hz times a second
+ * ($DRAWTERM_FLUSHHZ, default 60), sooner after a 'v'.  While
+ * flushproc waits out the rest of a frame, timerproc sleeps until
+ * due and wakes it; a 'v' wakes it sooner.  With hz 0, 'v'
+ * flushes synchronously in drawmesg.  The flags are set holding
+ * drawlock.
+ */
+static struct
+{
+	Rendez	r;		/* flushproc waits here */
+	Rendez	tr;		/* timerproc waits here */
+	int	hz;
+	int	now;		/* a 'v' wants the damage on the screen */
+	int	armed;		/* timerproc is to wake flushproc at due */
+	int	expired;	/* and has */
+	ulong	due;
+	int	init;
+} flusher;
+/*
+ * Counts for /dev/draw/stats: for each kind of message, how many
+ * there were, their bytes, about how many pixels they drew and
+ * the nanoseconds they took once they had the locks they needed;
+ * the same for runs of restacking drawn by drawcommit, and for
+ * flushes to the screen, with rectangles in place of bytes.
+ */
+typedef struct Dstat Dstat;
+struct Dstat
+{
+	uvlong	n;
+	uvlong	bytes;
+	uvlong	pix;
+	uvlong	ns;
+};
+
+static struct
+{
+	Lock	lk;
+	Dstat	op[256];
+	Dstat	commit;
+	Dstat	flush;
+} drawstats;
+
+/*
+ * Images loaded compressed, with 'Y', are remembered by a hash of
+ * their data, so that loading the same pixels again, as clients do
+ * with icons and fonts, is a plain load of the bytes decoded the
+ * first time instead of another decode.  Data seen for the first
+ * time only has its key remembered; it is decoded into the cache
+ * when it comes again, so data that is loaded once, such as video,
+ * costs just the hash.  The least recently used entries go when
+ * there are more than Nloadent of them or they take more than
+ * $DRAWTERM_LOADCACHE kilobytes (default 16384; 0 turns the cache
+ * off).  The hash is 64 bits and seeded at random; data that
+ * collides is taken to match.
+ */
+enum
+{
+	Nloadhash	= 1024,
+	Nloadent	= 4096,
+	Nloadmin	= 256,	/* smaller loads are not worth it */
+};
+
+typedef struct Lentry Lentry;
+struct Lentry
+{
+	uvlong	h;
+	int	n;		/* bytes of compressed data */
+	int	bpl;		/* bytes of image per line */
+	int	dy;		/* lines */
+	uchar	*data;		/* decoded; nil until seen twice */
+	int	ref;		/* loads reading data; not trimmed */
+	Lentry	*hnext;
+	Lentry	*prev;		/* more recently used */
+	Lentry	*next;		/* less recently used */
+};
+
+static struct
+{
+	QLock	lk;
+	Lentry	*hash[Nloadhash];
+	Lentry	*head;
+	Lentry	*tail;
+	int	nent;
+	long	size;
+	long	max;
+	uvlong	seed;
+	uvlong	hit;
+	uvlong	miss;
+	int	init;
+} loadcache;
+
 static	DScreen*	dscreen;
+static	Memscreen*	tscreen;	/* restacking in a memlbegin */
 extern	void		flushmemscreen(Rectangle);
+extern	void		flushmemscreenrects(Rectangle*, int);
 	void		drawmesg(Client*, void*, int);
+	void		drawwakeall(void);
 	void		drawuninstall(Client*, int);
 	void		drawfreedimage(DImage*);
 	Client*		drawclientofpath(ulong);
@@ -184,6 +296,76 @@ static	char Eoldname[] =	"named image no longer valid";
 static	char Enamed[] = 	"image already has name";
 static	char Ewrongname[] = 	"wrong name for image";
 
+static void
+drawcount(Dstat *d, uvlong bytes, uvlong pix, vlong t0)
+{
+	vlong t;
+
+	t = osnsec()-t0;
+	lock(&drawstats.lk);
+	d->n++;
+	d->bytes += bytes;
+	d->pix += pix;
+	d->ns += t;
+	unlock(&drawstats.lk);
+}
+
+/*
+ * Pixels of r within clipr.
+ */
+static uvlong
+drawarea(Rectangle r, Rectangle clipr)
+{
+	if(!rectclip(&r, clipr))
+		return 0;
+	return (uvlong)Dx(r)*Dy(r);
+}
+
+static long
+drawreadstats(void *a, long n, vlong off)
+{
+	Dstat op[256], commit, flush;
+	uvlong hit, miss;
+	char *buf, *p, *e;
+	int i, nent;
+	long size;
+
+	lock(&drawstats.lk);
+	memmove(op, drawstats.op, sizeof op);
+	commit = drawstats.commit;
+	flush = drawstats.flush;
+	unlock(&drawstats.lk);
+	qlock(&loadcache.lk);
+	hit = loadcache.hit;
+	miss = loadcache.miss;
+	nent = loadcache.nent;
+	size = loadcache.size;
+	qunlock(&loadcache.lk);
+
+	buf = malloc(Nstatbuf);
+	if(buf == nil)
+		error(Enomem);
+	p = buf;
+	e = buf+Nstatbuf;
+	for(i=0; i<nelem(op); i++)
+		if(op[i].n > 0)
+			p = seprint(p, e, "%c %llud %llud %llud %llud\n", i,
+				op[i].n, op[i].bytes, op[i].pix, op[i].ns);
+	p = seprint(p, e, "commit %llud %llud %llud %llud\n",
+		commit.n, commit.bytes, commit.pix, commit.ns);
+	p = seprint(p, e, "flush %llud %llud %llud %llud\n",
+		flush.n, flush.bytes, flush.pix, flush.ns);
+	seprint(p, e, "loadcache %llud %llud %d %ld\n", hit, miss, nent, size);
+	if(waserror()){
+		free(buf);
+		nexterror();
+	}
+	n = readstr(off, a, n, buf);
+	poperror();
+	free(buf);
+	return n;
+}
+
 static void
 dlock(void)
 {
@@ -253,7 +435,7 @@ drawgen(Chan *c, char *n, Dirtab *d, int nd, int s, Dir *dp)
 	}
 
 	/*
-	 * Second level contains "new" plus all the clients.
+	 * Second level contains "new" and "stats" plus all the clients.
 	 */
 	switch(t){
 	case Q2nd:
@@ -263,6 +445,13 @@ drawgen(Chan *c, char *n, Dirtab *d, int nd, int s, Dir *dp)
 			devdir(c, q, "new", 0, eve, 0666, dp);
 			return 1;
 		}
+		if(s == 1){
+	case Qstats:
+			mkqid(&q, Qstats, 0, QTFILE);
+			devdir(c, q, "stats", 0, eve, 0444, dp);
+			return 1;
+		}
+		s--;
 		if(s <= sdraw.nclient){
 			cl = sdraw.client[s-1];
 			if(cl == nil)
@@ -354,47 +543,73 @@ drawrefresh(Memimage *i, Rectangle r, void *v)
 	}
 }
 
+/*
+ * Whether to flush a and b as one rectangle: they overlap,
+ * or the box around them is small or mostly a and b.
+ */
+static int
+flushmerge(Rectangle a, Rectangle b)
+{
+	Rectangle bb;
+	int abb, waste;
+
+	if(rectXrect(a, b))
+		return 1;
+	bb = a;
+	combinerect(&bb, b);
+	abb = Dx(bb)*Dy(bb);
+	waste = abb - Dx(a)*Dy(a) - Dx(b)*Dy(b);
+	return abb<=1024 || waste*2<abb;
+}
+
+/*
+ * Add r to the damage, keeping the rectangles disjoint:
+ * r swallows any it should merge with, and if there is no
+ * room for it, it merges with the one it grows least.
+ */
 static void
-addflush(Rectangle r)
+damage(Rectangle r)
 {
-	int abb, ar, anbb;
-	Rectangle nbb;
+	Rectangle bb;
+	int i, best, a, ba;
 
-	if(sdraw.softscreen==0 || screenimage == nil || !rectclip(&r, screenimage->r))
-		return;
-	if(flushrect.min.x >= flushrect.max.x){
-		flushrect = r;
-		waste = 0;
-		return;
+    Again:
+	for(i=0; i<nflush; i++){
+		if(rectinrect(r, flushrect[i]))
+			return;
+		if(flushmerge(flushrect[i], r)){
+			combinerect(&r, flushrect[i]);
+			flushrect[i] = flushrect[--nflush];
+			goto Again;
+		}
 	}
-	nbb = flushrect;
-	combinerect(&nbb, r);
-	ar = Dx(r)*Dy(r);
-	abb = Dx(flushrect)*Dy(flushrect);
-	anbb = Dx(nbb)*Dy(nbb);
-	/*
-	 * Area of new waste is area of new bb minus area of old bb,
-	 * less the area of the new segment, which we assume is not waste.
-	 * This could be negative, but that's OK.
-	 */
-	waste += anbb-abb - ar;
-	if(waste < 0)
-		waste = 0;
-	/*
-	 * absorb if:
-	 *	total area is small
-	 *	waste is less than half total area
-	 * 	rectangles touch
-	 */
-	if(anbb<=1024 || waste*2<anbb || rectXrect(flushrect, r)){
-		flushrect = nbb;
-		return;
+	if(nflush == Nflush){
+		best = 0;
+		ba = 0;
+		for(i=0; i<nflush; i++){
+			bb = flushrect[i];
+			combinerect(&bb, r);
+			a = Dx(bb)*Dy(bb) - Dx(flushrect[i])*Dy(flushrect[i]);
+			if(i == 0 || a < ba){
+				best = i;
+				ba = a;
+			}
+		}
+		combinerect(&r, flushrect[best]);
+		flushrect[best] = flushrect[--nflush];
+		goto Again;
 	}
-	/* emit current state */
-	if(flushrect.min.x < flushrect.max.x)
-		flushmemscreen(flushrect);
-	flushrect = r;
-	waste = 0;
+	flushrect[nflush++] = r;
+	if(nflush == 1 && flusher.hz > 0)
+		wakeup(&flusher.r);
+}
+
+static void
+addflush(Rectangle r)
+{
+	if(sdraw.softscreen==0 || screenimage == nil || !rectclip(&r, screenimage->r))
+		return;
+	damage(r);
 }
 
 static
@@ -404,7 +619,8 @@ dstflush(int dstid, Memimage *dst, Rectangle r)
 	Memlayer *l;
 
 	if(dstid == 0){
-		combinerect(&flushrect, r);
+		if(screenimage && rectclip(&r, screenimage->r))
+			damage(r);
 		return;
 	}
 	if(screenimage == nil || dst == nil || (l = dst->layer) == nil)
@@ -418,12 +634,519 @@ dstflush(int dstid, Memimage *dst, Rectangle r)
 	addflush(r);
 }
 
+struct Commit
+{
+	Memscreen	*s;
+	int		flush;
+	uvlong		pix;
+};
+
+static
+void
+committed(Rectangle r, void *etc)
+{
+	struct Commit *c;
+
+	c = etc;
+	c->pix += drawarea(r, c->s->image->r);
+	if(c->flush)
+		addflush(r);
+}
+
+/*
+ * A run of 't' and 'o' messages on one screen is drawn
+ * all at once when the run ends.
+ */
+static
+void
+drawcommit(void)
+{
+	struct Commit c;
+	vlong t0;
+
+	c.s = tscreen;
+	if(c.s == nil)
+		return;
+	tscreen = nil;
+	c.flush = screenimage && c.s->image->data == screenimage->data;
+	c.pix = 0;
+	t0 = osnsec();
+	memlcommit(c.s, committed, &c);
+	drawcount(&drawstats.commit, 0, c.pix, t0);
+}
+
+static
+void
+drawbegin(Memscreen *s)
+{
+	if(tscreen == s)
+		return;
+	drawcommit();
+	if(memlbegin(s) == 0)
+		tscreen = s;
+}
+
 void
 drawflush(void)
 {
-	if(screenimage && flushrect.min.x < flushrect.max.x)
-		flushmemscreen(flushrect);
-	flushrect = Rect(10000, 10000, -10000, -10000);
+	uvlong pix;
+	vlong t0;
+	int i;
+
+	if(screenimage && nflush > 0){
+		pix = 0;
+		for(i=0; i<nflush; i++)
+			pix += drawarea(flushrect[i], screenimage->r);
+		t0 = osnsec();
+		flushmemscreenrects(flushrect, nflush);
+		drawcount(&drawstats.flush, nflush, pix, t0);
+	}
+	nflush = 0;
+}
+
+static int
+flushready(void *a)
+{
+	USED(a);
+	return nflush > 0;
+}
+
+static int
+flushdue(void *a)
+{
+	USED(a);
+	return flusher.now || flusher.expired;
+}
+
+static int
+timerarmed(void *a)
+{
+	USED(a);
+	return flusher.armed;
+}
+
+static void
+timerproc(void *a)
+{
+	long t;
+
+	USED(a);
+	for(;;){
+		sleep(&flusher.tr, timerarmed, nil);
+		for(;;){
+			dlock();
+			t = flusher.due - ticks();
+			if(t <= 0){
+				flusher.armed = 0;
+				flusher.expired = 1;
+				dunlock();
+				break;
+			}
+			dunlock();
+			osmsleep(t);
+		}
+		wakeup(&flusher.r);
+	}
+}
+
+static void
+flushproc(void *a)
+{
+	ulong last;
+	int wait;
+
+	USED(a);
+	last = ticks();
+	for(;;){
+		/* timerproc may wake us late, after a 'v' */
+		do
+			sleep(&flusher.r, flushready, nil);
+		while(!flushready(nil));
+		/* let more damage gather, unless a 'v' wants it now */
+		dlock();
+		flusher.due = last + 1000/flusher.hz;
+		wait = !flusher.now && (long)(flusher.due - ticks()) > 0;
+		if(wait){
+			flusher.expired = 0;
+			flusher.armed = 1;
+		}
+		dunlock();
+		if(wait){
+			wakeup(&flusher.tr);
+			do
+				sleep(&flusher.r, flushdue, nil);
+			while(!flushdue(nil));
+		}
+		dlock();
+		flusher.now = 0;
+		drawflush();
+		dunlock();
+		last = ticks();
+	}
+}
+
+static void
+flushinit(void)
+{
+	char *s;
+
+	if(flusher.init)
+		return;
+	flusher.init = 1;
+	flusher.hz = 60;
+	if((s = getenv("DRAWTERM_FLUSHHZ")) != nil)
+		flusher.hz = atoi(s);
+	if(flusher.hz > 1000)
+		flusher.hz = 1000;
+	if(flusher.hz > 0){
+		kproc("drawflush", flushproc, nil);
+		kproc("drawtimer", timerproc, nil);
+	}
+}
+
+/*
+ * With $DRAWTERM_DRAWLOG naming a host file (by absolute path),
+ * every write to a client's data file is appended to it for
+ * bench/drawreplay.  The log starts with the screen,
+ *	's' R[4*4] chan[4]
+ * followed, in the order they happened, by
+ *	'w' clientid[4] msec[4] n[4] data[n]
+ * for each write and
+ *	'c' clientid[4]
+ * when a client goes away.  Integers are in draw message order.
+ */
+static struct
+{
+	QLock	lk;
+	Chan	*c;
+	vlong	off;
+	ulong	t0;
+	int	init;
+} drawlog;
+
+static void
+drawlogput(uchar *a, int n, void *data, int ndata)
+{
+	Chan *c;
+
+	qlock(&drawlog.lk);
+	if((c = drawlog.c) == nil){
+		qunlock(&drawlog.lk);
+		return;
+	}
+	if(waserror()){
+		/* stop logging rather than fail the client */
+		drawlog.c = nil;
+		qunlock(&drawlog.lk);
+		print("draw log: %s\n", up->errstr);
+		cclose(c);
+		return;
+	}
+	drawlog.off += devtab[c->type]->write(c, a, n, drawlog.off);
+	if(ndata > 0)
+		drawlog.off += devtab[c->type]->write(c, data, ndata, drawlog.off);
+	poperror();
+	qunlock(&drawlog.lk);
+}
+
+static void
+drawlogwrite(Client *cl, void *data, int n)
+{
+	uchar a[1+4+4+4];
+
+	a[0] = 'w';
+	BPLONG(a+1, cl->clientid);
+	BPLONG(a+5, ticks()-drawlog.t0);
+	BPLONG(a+9, n);
+	drawlogput(a, sizeof a, data, n);
+}
+
+static void
+drawlogclose(Client *cl)
+{
+	uchar a[1+4];
+
+	a[0] = 'c';
+	BPLONG(a+1, cl->clientid);
+	drawlogput(a, sizeof a, nil, 0);
+}
+
+static void
+drawloginit(void)
+{
+	uchar a[1+4*4+4];
+	char *s, *p;
+
+	if(drawlog.init)
+		return;
+	drawlog.init = 1;
+	if((s = getenv("DRAWTERM_DRAWLOG")) == nil || *s == 0)
+		return;
+	p = smprint("#U%s", s);
+	if(waserror()){
+		print("draw log %s: %s\n", s, up->errstr);
+		free(p);
+		return;
+	}
+	drawlog.c = namec(p, Acreate, OWRITE, 0666);
+	poperror();
+	free(p);
+	drawlog.t0 = ticks();
+	a[0] = 's';
+	BPLONG(a+1, screenimage->r.min.x);
+	BPLONG(a+5, screenimage->r.min.y);
+	BPLONG(a+9, screenimage->r.max.x);
+	BPLONG(a+13, screenimage->r.max.y);
+	BPLONG(a+17, screenimage->chan);
+	drawlogput(a, sizeof a, nil, 0);
+}
+
+static uvlong
+loadhash(uchar *a, int n)
+{
+	uvlong h, v;
+
+	h = loadcache.seed ^ (uvlong)n;
+	for(; n >= 8; n -= 8, a += 8){
+		memmove(&v, a, 8);
+		h = (h ^ v) * 0x9E3779B97F4A7C15ULL;
+		h ^= h >> 29;
+	}
+	for(v=0; n > 0; n--)
+		v = v<<8 | *a++;
+	h = (h ^ v) * 0x9E3779B97F4A7C15ULL;
+	h ^= h >> 32;
+	h *= 0xBF58476D1CE4E5B9ULL;
+	h ^= h >> 29;
+	return h;
+}
+
+/*
+ * Bytes of compressed data at a making m bytes of image, or -1 if
+ * there are not that many.
+ */
+static int
+loadclen(uchar *a, int n, int m)
+{
+	uchar *u, *eu;
+	int c;
+
+	u = a;
+	eu = a+n;
+	while(m > 0){
+		if(u >= eu)
+			return -1;
+		c = *u++;
+		if(c >= 128){
+			u += c-128+1;
+			m -= c-128+1;
+		}else{
+			u++;
+			m -= (c>>2)+NMATCH;
+		}
+	}
+	if(u > eu)
+		return -1;
+	return u-a;
+}
+
+static Lentry**
+loadlook(Lentry *k)
+{
+	Lentry **l, *e;
+
+	for(l=&loadcache.hash[k->h%Nloadhash]; (e = *l) != nil; l=&e->hnext)
+		if(e->h==k->h && e->n==k->n && e->bpl==k->bpl && e->dy==k->dy)
+			break;
+	return l;
+}
+
+static void
+loadunlink(Lentry *e)
+{
+	if(e->prev)
+		e->prev->next = e->next;
+	else
+		loadcache.head = e->next;
+	if(e->next)
+		e->next->prev = e->prev;
+	else
+		loadcache.tail = e->prev;
+	e->prev = e->next = nil;
+}
+
+static void
+loadfront(Lentry *e)
+{
+	if(loadcache.head == e)
+		return;
+	if(e->prev || e->next || loadcache.tail == e)
+		loadunlink(e);
+	e->next = loadcache.head;
+	if(e->next)
+		e->next->prev = e;
+	else
+		loadcache.tail = e;
+	loadcache.head = e;
+}
+
+/*
+ * Drop the least recently used entries that are not in use
+ * until the cache fits again, or only those in use are left.
+ */
+static void
+loadtrim(void)
+{
+	Lentry *e, *p;
+
+	for(e=loadcache.tail; e != nil; e=p){
+		if(loadcache.nent <= Nloadent && loadcache.size <= loadcache.max)
+			break;
+		p = e->prev;
+		if(e->ref > 0)
+			continue;
+		loadunlink(e);
+		*loadlook(e) = e->hnext;
+		if(e->data != nil){
+			free(e->data);
+			loadcache.size -= e->bpl*e->dy;
+		}
+		free(e);
+		loadcache.nent--;
+	}
+}
+
+static void
+loadcacheinit(void)
+{
+	char *s;
+
+	if(loadcache.init)
+		return;
+	loadcache.init = 1;
+	loadcache.max = 16384;
+	if((s = getenv("DRAWTERM_LOADCACHE")) != nil)
+		loadcache.max = atoi(s);
+	loadcache.max *= 1024;
+	randomread(&loadcache.seed, sizeof loadcache.seed);
+}
+
+/*
+ * The m bytes that the compressed data at a makes of r, or nil.
+ */
+static uchar*
+loaddecode(Rectangle r, ulong chan, uchar *a, int n, int m)
+{
+	Memimage *i;
+	uchar *data;
+
+	r = rectsubpt(r, r.min);
+	if((i = allocmemimage(r, chan)) == nil)
+		return nil;
+	data = nil;
+	if(cloadmemimage(i, r, a, n) == n && (data = malloc(m)) != nil)
+		if(unloadmemimage(i, r, data, m) != m){
+			free(data);
+			data = nil;
+		}
+	freememimage(i);
+	return data;
+}
+
+/*
+ * memload, through the cache.
+ */
+static int
+drawload(Memimage *dst, Rectangle r, uchar *a, int n, int iscompressed)
+{
+	Lentry k, *e, **l;
+	uchar *data;
+	int m, y, seen;
+
+	/*
+	 * cloadmemimage writes whole bytes, loadmemimage only the
+	 * pixels in r, so lines must start and end on bytes.
+	 */
+	if(!iscompressed || loadcache.max <= 0 || badrect(r)
+	|| (r.min.x*dst->depth | r.max.x*dst->depth) & 7)
+		return memload(dst, r, a, n, iscompressed);
+	memset(&k, 0, sizeof k);
+	k.bpl = bytesperline(r, dst->depth);
+	k.dy = Dy(r);
+	m = k.bpl*k.dy;
+	if(m < Nloadmin || m > loadcache.max/4)
+		return memload(dst, r, a, n, iscompressed);
+	/* data mostly literal decodes about as fast as it loads */
+	if((k.n = loadclen(a, n, m)) < 0 || k.n > m/2)
+		return memload(dst, r, a, n, iscompressed);
+	k.h = loadhash(a, k.n);
+
+	qlock(&loadcache.lk);
+	e = *loadlook(&k);
+	if(e != nil && e->data != nil){
+		loadfront(e);
+		loadcache.hit++;
+		/* keep e while loading from it, but not the lock */
+		e->ref++;
+		qunlock(&loadcache.lk);
+		if(memload(dst, r, e->data, m, 0) != m)
+			k.n = -1;
+		qlock(&loadcache.lk);
+		e->ref--;
+		loadtrim();
+		qunlock(&loadcache.lk);
+		return k.n;
+	}
+	loadcache.miss++;
+	seen = e != nil;
+	if(seen)
+		loadfront(e);
+	else if((e = malloc(sizeof *e)) != nil){
+		*e = k;
+		l = &loadcache.hash[k.h%Nloadhash];
+		e->hnext = *l;
+		*l = e;
+		loadfront(e);
+		loadcache.nent++;
+		loadtrim();
+	}
+	qunlock(&loadcache.lk);
+
+	y = memload(dst, r, a, n, iscompressed);
+	if(!seen || y != k.n)
+		return y;
+
+	/* the second time: keep it */
+	if((data = loaddecode(r, dst->chan, a, k.n, m)) == nil)
+		return y;
+	qlock(&loadcache.lk);
+	e = *loadlook(&k);
+	if(e != nil && e->data == nil){
+		e->data = data;
+		data = nil;
+		loadcache.size += m;
+		loadfront(e);
+		loadtrim();
+	}
+	qunlock(&loadcache.lk);
+	free(data);
+	return y;
+}
+
+/*
+ * Put the damage on the screen soon, or now if there is no flusher.
+ */
+static void
+drawvisible(void)
+{
+	if(flusher.hz <= 0){
+		drawflush();
+		return;
+	}
+	if(nflush > 0){
+		flusher.now = 1;
+		wakeup(&flusher.r);
+	}
 }
 
 int
@@ -465,21 +1188,110 @@ drawgoodname(DImage *d)
 	return 1;
 }
 
+static uint
+dimagehash(int id)
+{
+	uint h;
+
+	h = id*0x9E3779B1U;
+	return h ^ h>>16;
+}
+
+/*
+ * The slot holding id in client's image table, or -1.
+ */
+static int
+dimageslot(Client *client, int id)
+{
+	int i, mask;
+
+	if(client->dimage == nil)
+		return -1;
+	mask = client->ndimage-1;
+	for(i=dimagehash(id)&mask; client->dimage[i]; i=(i+1)&mask)
+		if(client->dimage[i]->id == id)
+			return i;
+	return -1;
+}
+
+static void
+dimageput(DImage **tab, int n, DImage *d)
+{
+	int i;
+
+	for(i=dimagehash(d->id)&(n-1); tab[i]; i=(i+1)&(n-1))
+		;
+	tab[i] = d;
+}
+
+/*
+ * Make room for one more image, keeping the table
+ * no more than three quarters full.
+ */
+static int
+dimagegrow(Client *client)
+{
+	DImage **tab;
+	int i, n;
+
+	if(4*(client->nused+1) <= 3*client->ndimage)
+		return 0;
+	n = client->ndimage ? 2*client->ndimage : NHASH;
+	tab = mallocz(n*sizeof(DImage*), 1);
+	if(tab == nil)
+		return -1;
+	for(i=0; i<client->ndimage; i++)
+		if(client->dimage[i])
+			dimageput(tab, n, client->dimage[i]);
+	free(client->dimage);
+	client->dimage = tab;
+	client->ndimage = n;
+	return 0;
+}
+
+/*
+ * Empty slot i, moving back later images in its run
+ * that would otherwise no longer be found.
+ */
+static void
+dimagedel(Client *client, int i)
+{
+	DImage **tab, *d;
+	int j, k, mask;
+
+	tab = client->dimage;
+	mask = client->ndimage-1;
+	if(client->lastdimage == tab[i])
+		client->lastdimage = nil;
+	tab[i] = nil;
+	client->nused--;
+	for(j=(i+1)&mask; (d = tab[j]) != nil; j=(j+1)&mask){
+		k = dimagehash(d->id)&mask;
+		if(i <= j ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+		tab[i] = d;
+		tab[j] = nil;
+		i = j;
+	}
+}
+
 DImage*
 drawlookup(Client *client, int id, int checkname)
 {
 	DImage *d;
+	int i;
 
-	d = client->dimage[id&HASHMASK];
-	while(d){
-		if(d->id == id){
-			if(checkname && !drawgoodname(d))
-				error(Eoldname);
-			return d;
-		}
-		d = d->next;
+	d = client->lastdimage;
+	if(d == nil || d->id != id){
+		i = dimageslot(client, id);
+		if(i < 0)
+			return 0;
+		d = client->dimage[i];
+		client->lastdimage = d;
 	}
-	return 0;
+	if(checkname && !drawgoodname(d))
+		error(Eoldname);
+	return d;
 }
 
 DScreen*
@@ -537,13 +1349,15 @@ drawinstall(Client *client, int id, Memimage *i, DScreen *dscreen)
 {
 	DImage *d;
 
+	if(dimagegrow(client) < 0)
+		return 0;
 	d = allocdimage(i);
 	if(d == 0)
 		return 0;
 	d->id = id;
 	d->dscreen = dscreen;
-	d->next = client->dimage[id&HASHMASK];
-	client->dimage[id&HASHMASK] = d;
+	dimageput(client->dimage, client->ndimage, d);
+	client->nused++;
 	return i;
 }
 
@@ -573,6 +1387,7 @@ drawinstallscreen(Client *client, DScreen *d, int id, DImage *dimage, DImage *df
 		}
 		s->frontmost = 0;
 		s->rearmost = 0;
+		s->trans = 0;
 		d->dimage = dimage;
 		if(dimage){
 			s->image = dimage->image;
@@ -711,25 +1526,15 @@ drawuninstallscreen(Client *client, CScreen *this)
 void
 drawuninstall(Client *client, int id)
 {
-	DImage *d, *next;
+	DImage *d;
+	int i;
 
-	d = client->dimage[id&HASHMASK];
-	if(d == 0)
+	i = dimageslot(client, id);
+	if(i < 0)
 		error(Enodrawimage);
-	if(d->id == id){
-		client->dimage[id&HASHMASK] = d->next;
-		drawfreedimage(d);
-		return;
-	}
-	while((next = d->next) != nil){
-		if(next->id == id){
-			d->next = next->next;
-			drawfreedimage(next);
-			return;
-		}
-		d = next;
-	}
-	error(Enodrawimage);
+	d = client->dimage[i];
+	dimagedel(client, i);
+	drawfreedimage(d);
 }
 
 void
@@ -915,6 +1720,44 @@ drawchar(Memimage *dst, Memimage *rdst, Point p, Memimage *src, Point *sp, DImag
 	return p;
 }
 
+/*
+ * Draw the ni glyph indices at u as one run; the indices
+ * have already been checked.
+ */
+Point
+drawstring(Memimage *dst, Memimage *rdst, Point p, Memimage *src, Point *sp, DImage *font, uchar *u, int ni, int op)
+{
+	Memglyph g[64];
+	FChar *fc;
+	int n;
+
+	if(ishwimage(dst) && !ishwimage(rdst) && font->image->depth > 1){
+		for(; ni > 0; ni--, u += 2)
+			p = drawchar(dst, rdst, p, src, sp, font, BGSHORT(u), op);
+		return p;
+	}
+	n = 0;
+	for(; ni > 0; ni--, u += 2){
+		fc = &font->fchar[BGSHORT(u)];
+		g[n].r.min.x = p.x+fc->left;
+		g[n].r.min.y = p.y-(font->ascent-fc->miny);
+		g[n].r.max.x = g[n].r.min.x+(fc->maxx-fc->minx);
+		g[n].r.max.y = g[n].r.min.y+(fc->maxy-fc->miny);
+		g[n].sp.x = sp->x+fc->left;
+		g[n].sp.y = sp->y+fc->miny;
+		g[n].mp = Pt(fc->minx, fc->miny);
+		p.x += fc->width;
+		sp->x += fc->width;
+		if(++n == nelem(g)){
+			memglyphs(dst, src, font->image, g, n, op);
+			n = 0;
+		}
+	}
+	if(n > 0)
+		memglyphs(dst, src, font->image, g, n, op);
+	return p;
+}
+
 static DImage*
 makescreenimage(void)
 {
@@ -993,6 +1836,10 @@ drawattach(char *spec)
 		dunlock();
 		error("no frame buffer");
 	}
+	drawprocinit();
+	flushinit();
+	drawloginit();
+	loadcacheinit();
 	dunlock();
 	return devattach('i', spec);
 }
@@ -1048,7 +1895,7 @@ drawopen(Chan *c, int omode)
 		if(cl->busy)
 			error(Einuse);
 		cl->busy = 1;
-		flushrect = Rect(10000, 10000, -10000, -10000);
+		nflush = 0;
 		dn = drawlookupname(strlen(screenname), screenname);
 		if(dn == 0)
 			error("draw: cannot happen 2");
@@ -1085,22 +1932,26 @@ static void
 drawclose(Chan *c)
 {
 	int i;
-	DImage *d, **dp;
+	DImage *d;
 	Client *cl;
 	Refresh *r;
 
 	if(QID(c->qid) < Qcolormap)	/* Qtopdir, Qnew, Q3rd, Q2nd have no client */
 		return;
+	cl = drawclient(c);
+	qlock(&cl->lk);
 	dlock();
 	if(waserror()){
 		dunlock();
+		qunlock(&cl->lk);
 		nexterror();
 	}
 
-	cl = drawclient(c);
 	if(QID(c->qid) == Qctl)
 		cl->busy = 0;
 	if((c->flag&COPEN) && (decref(&cl->r)==0)){
+		if(drawlog.c != nil)
+			drawlogclose(cl);
 		while((r = cl->refresh) != nil){
 			cl->refresh = r->next;
 			free(r);
@@ -1114,19 +1965,26 @@ drawclose(Chan *c)
 		while(cl->cscreen)
 			drawuninstallscreen(cl, cl->cscreen);
 		/* all screens are freed, so now we can free images */
-		dp = cl->dimage;
-		for(i=0; i<NHASH; i++){
-			while((d = *dp) != nil){
-				*dp = d->next;
+		cl->lastdimage = nil;
+		for(i=0; i<cl->ndimage; i++)
+			if((d = cl->dimage[i]) != nil){
+				cl->dimage[i] = nil;
 				drawfreedimage(d);
 			}
-			dp++;
-		}
+		free(cl->dimage);
+		cl->dimage = nil;
+		cl->ndimage = 0;
+		cl->nused = 0;
 		sdraw.client[cl->slot] = 0;
 		drawflush();	/* to erase visible, now dead windows */
+		dunlock();
+		qunlock(&cl->lk);
+		poperror();
 		free(cl);
+		return;
 	}
 	dunlock();
+	qunlock(&cl->lk);
 	poperror();
 }
 
@@ -1147,11 +2005,35 @@ drawread(Chan *c, void *a, long n, vlong off)
 		return devdirread(c, a, n, 0, 0, drawgen);
 	if(QID(c->qid) == Qwinname)
 		return readstr(off, a, n, screenname);
+	if(QID(c->qid) == Qstats)
+		return drawreadstats(a, n, off);
 
 	cl = drawclient(c);
+	if(QID(c->qid) == Qdata){
+		qlock(&cl->lk);
+		if(waserror()){
+			qunlock(&cl->lk);
+			nexterror();
+		}
+		if(cl->readdata == nil)
+			error("no draw data");
+		if(n < cl->nreaddata)
+			error(Eshortread);
+		n = cl->nreaddata;
+		memmove(a, cl->readdata, cl->nreaddata);
+		free(cl->readdata);
+		cl->readdata = nil;
+		qunlock(&cl->lk);
+		poperror();
+		return n;
+	}
+	if(QID(c->qid) == Qctl)
+		qlock(&cl->lk);
 	dlock();
 	if(waserror()){
 		dunlock();
+		if(QID(c->qid) == Qctl)
+			qunlock(&cl->lk);
 		nexterror();
 	}
 	switch(QID(c->qid)){
@@ -1191,17 +2073,6 @@ drawread(Chan *c, void *a, long n, vlong off)
 		free(p);
 		break;
 
-	case Qdata:
-		if(cl->readdata == nil)
-			error("no draw data");
-		if(n < cl->nreaddata)
-			error(Eshortread);
-		n = cl->nreaddata;
-		memmove(a, cl->readdata, cl->nreaddata);
-		free(cl->readdata);
-		cl->readdata = nil;
-		break;
-
 	case Qrefresh:
 		if(n < 5*4)
 			error(Ebadarg);
@@ -1242,6 +2113,8 @@ drawread(Chan *c, void *a, long n, vlong off)
 		break;
 	}
 	dunlock();
+	if(QID(c->qid) == Qctl)
+		qunlock(&cl->lk);
 	poperror();
 	return n;
 }
@@ -1271,9 +2144,21 @@ drawwrite(Chan *c, void *a, long n, vlong off)
 	if(c->qid.type & QTDIR)
 		error(Eisdir);
 	cl = drawclient(c);
+	if(QID(c->qid) == Qdata){
+		qlock(&cl->lk);
+		if(waserror()){
+			qunlock(&cl->lk);
+			nexterror();
+		}
+		if(drawlog.c != nil)
+			drawlogwrite(cl, a, n);
+		drawmesg(cl, a, n);
+		qunlock(&cl->lk);
+		poperror();
+		return n;
+	}
 	dlock();
 	if(waserror()){
-		drawwakeall();
 		dunlock();
 		nexterror();
 	}
@@ -1319,11 +2204,6 @@ drawwrite(Chan *c, void *a, long n, vlong off)
 		}
 		break;
 
-	case Qdata:
-		drawmesg(cl, a, n);
-		drawwakeall();
-		break;
-
 	default:
 		error(Ebadusefd);
 	}
@@ -1410,6 +2290,91 @@ printmesg(char *fmt, uchar *a, int plsprnt)
 	iprint("%.*s", (int)(q-buf), buf);
 }
 
+/*
+ * Whether the image with the id at a is seen by the client alone:
+ * not a window, not named or from a name, and not a screen's image
+ * or fill.  Nil ids count, as the message will fail anyway.
+ */
+static int
+privateimage(Client *client, uchar *a)
+{
+	DImage *d;
+
+	d = drawlookup(client, BGLONG(a), 0);
+	if(d == nil)
+		return 1;
+	return d->ref == 1 && d->name == nil && d->fromname == nil
+		&& d->dscreen == nil && d->image->layer == nil;
+}
+
+/*
+ * Messages that can touch only private images, with the offsets
+ * of their image ids and how long they must be to hold them.
+ */
+static struct
+{
+	char	c;
+	int	n;
+	int	id[4];
+} privmesg[] = {
+	'a',	25,	{1, 21},
+	'c',	5,	{1},
+	'd',	13,	{1, 5, 9},
+	'e',	9,	{1, 5},
+	'E',	9,	{1, 5},
+	'l',	9,	{1, 5},
+	'L',	37,	{1, 33},
+	'p',	23,	{1, 19},
+	'P',	23,	{1, 19},
+	'r',	5,	{1},
+	's',	13,	{1, 5, 9},
+	'x',	51,	{1, 5, 9, 47},
+	'y',	5,	{1},
+	'Y',	5,	{1},
+};
+
+/*
+ * Whether the message at a can be done without drawlock.
+ */
+static int
+drawprivate(Client *client, uchar *a, int n)
+{
+	int i, j;
+
+	switch(*a){
+	case 'D':
+	case 'O':
+		return 1;
+	case 'b':
+		return n >= 9 && BGLONG(a+5) == 0;
+	}
+	for(i=0; i<nelem(privmesg); i++){
+		if(privmesg[i].c != *a)
+			continue;
+		if(n < privmesg[i].n)
+			return 0;
+		for(j=0; j<nelem(privmesg[i].id) && privmesg[i].id[j]; j++)
+			if(!privateimage(client, a+privmesg[i].id[j]))
+				return 0;
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Finish the client's shared work and let others at the screen.
+ */
+static void
+mesgunlock(Client *client)
+{
+	if(!client->drawlocked)
+		return;
+	drawcommit();
+	drawwakeall();
+	client->drawlocked = 0;
+	dunlock();
+}
+
 void
 drawmesg(Client *client, void *av, int n)
 {
@@ -1430,18 +2395,34 @@ drawmesg(Client *client, void *av, int n)
 	CScreen *cs;
 	Refreshfn reffn;
 	Warp w;
+	uvlong px;
+	vlong t0;
 
 	a = av;
 	m = 0;
 	fmt = nil;
+	px = 0;
+	t0 = 0;
 	if(waserror()){
+		mesgunlock(client);
 		if(fmt) printmesg(fmt, a, 1);
 	/*	iprint("error: %s\n", up->errstr);	*/
 		nexterror();
 	}
 	while((n-=m) > 0){
 		USED(fmt);
+		if(m > 0)
+			drawcount(&drawstats.op[*a], m, px, t0);
 		a += m;
+		if(drawprivate(client, a, n))
+			mesgunlock(client);
+		else if(!client->drawlocked){
+			dlock();
+			client->drawlocked = 1;
+		}else if(*a!='t' && *a!='o')
+			drawcommit();
+		px = 0;
+		t0 = osnsec();
 		switch(*a){
 		default:
 			error("bad draw command");
@@ -1482,6 +2463,7 @@ drawmesg(Client *client, void *av, int n)
 				l = memlalloc(scrn, r, reffn, 0, value);
 				if(l == 0)
 					error(Edrawmem);
+				px = drawarea(r, r);
 				addflush(l->layer->screenr);
 				l->clipr = clipr;
 				rectclip(&l->clipr, r);
@@ -1518,6 +2500,7 @@ drawmesg(Client *client, void *av, int n)
 				error(Edrawmem);
 			}
 			memfillcolor(i, value);
+			px = drawarea(r, r);
 			continue;
 
 		/* apply affine transform: 'a' dstid[4] R[4*4] srcid[4] P[2*4] M[3*3*4] smooth[1] */
@@ -1534,6 +2517,7 @@ drawmesg(Client *client, void *av, int n)
 			drawwarp(w, a+33);
 			if(memaffinewarp(dst, r, src, p, w, a[33+3*3*4]) < 0)
 				error("memaffinewarp failed");
+			px = drawarea(r, dst->clipr);
 			dstflush(dstid, dst, r);
 			continue;
 
@@ -1588,6 +2572,7 @@ drawmesg(Client *client, void *av, int n)
 			drawpoint(&q, a+37);
 			op = drawclientop(client);
 			memdraw(dst, r, src, p, mask, q, op);
+			px = drawarea(r, dst->clipr);
 			dstflush(dstid, dst, r);
 			continue;
 
@@ -1631,7 +2616,9 @@ drawmesg(Client *client, void *av, int n)
 				memarc(dst, p, e0, e1, c, src, sp, ox, oy, op);
 			}else
 				memellipse(dst, p, e0, e1, c, src, sp, op);
-			dstflush(dstid, dst, Rect(p.x-e0-j, p.y-e1-j, p.x+e0+j+1, p.y+e1+j+1));
+			r = Rect(p.x-e0-j, p.y-e1-j, p.x+e0+j+1, p.y+e1+j+1);
+			px = drawarea(r, dst->clipr);
+			dstflush(dstid, dst, r);
 			continue;
 
 		/* free: 'f' id[4] */
@@ -1700,6 +2687,7 @@ drawmesg(Client *client, void *av, int n)
 			drawrectangle(&r, a+11);
 			drawpoint(&p, a+27);
 			memdraw(font->image, r, src, p, memopaque, p, S);
+			px = drawarea(r, font->image->clipr);
 			fc = &font->fchar[ci];
 			fc->minx = r.min.x;
 			fc->maxx = r.max.x;
@@ -1728,6 +2716,7 @@ drawmesg(Client *client, void *av, int n)
 			drawpoint(&sp, a+37);
 			op = drawclientop(client);
 			memline(dst, p, q, e0, e1, j, src, sp, op);
+			px = (uvlong)(abs(q.x-p.x)+abs(q.y-p.y)+1)*(2*j+1);
 			/* avoid memlinebbox if possible */
 			if(dstid==0 || dst->layer!=nil){
 				/* BUG: this is terribly inefficient: update maximal containing rect*/
@@ -1821,12 +2810,15 @@ drawmesg(Client *client, void *av, int n)
 				drawpoint(&p, a+5);
 				drawpoint(&q, a+13);
 				r = dst->layer->screenr;
+				drawbegin(dst->layer->screen);
 				ni = memlorigin(dst, p, q);
 				if(ni < 0)
 					error("image origin failed");
 				if(ni > 0){
-					addflush(r);
-					addflush(dst->layer->screenr);
+					if(tscreen == nil){
+						addflush(r);
+						addflush(dst->layer->screenr);
+					}
 					ll = drawlookup(client, BGLONG(a+1), 1);
 					drawrefreshscreen(ll, client);
 				}
@@ -1915,6 +2907,14 @@ drawmesg(Client *client, void *av, int n)
 				mempoly(dst, pp, ni, e0, e1, j, src, sp, op);
 			else
 				memfillpoly(dst, pp, ni, e0, src, sp, op);
+			r = Rpt(pp[0], addpt(pp[0], Pt(1, 1)));
+			for(y=1; y<ni; y++)
+				if(*a == 'p')
+					px += (uvlong)(abs(pp[y].x-pp[y-1].x)+abs(pp[y].y-pp[y-1].y)+1)*(2*j+1);
+				else
+					combinerect(&r, Rpt(pp[y], addpt(pp[y], Pt(1, 1))));
+			if(*a == 'P')
+				px = drawarea(r, dst->clipr);
 			free(pp);
 			m = u-a;
 			continue;
@@ -1936,6 +2936,7 @@ drawmesg(Client *client, void *av, int n)
 			if(client->readdata == nil)
 				error("readimage malloc failed");
 			client->nreaddata = memunload(i, r, client->readdata, c);
+			px = drawarea(r, r);
 			if(client->nreaddata < 0){
 				free(client->readdata);
 				client->readdata = nil;
@@ -1974,39 +2975,28 @@ drawmesg(Client *client, void *av, int n)
 			dst->clipr = r;
 			op = drawclientop(client);
 			bg = dst;
+			r.min.x = p.x;
+			r.min.y = p.y-font->ascent;
+			r.max.x = p.x;
+			r.max.y = r.min.y+Dy(font->image->r);
+			for(j=0; j<ni; j++){
+				ci = BGSHORT(u+2*j);
+				if(ci<0 || ci>=font->nfchar){
+					dst->clipr = clipr;
+					error(Eindex);
+				}
+				r.max.x += font->fchar[ci].width;
+			}
 			if(*a == 'x'){
 				/* paint background */
 				bg = drawimage(client, a+47);
 				drawpoint(&q, a+51);
-				r.min.x = p.x;
-				r.min.y = p.y-font->ascent;
-				r.max.x = p.x;
-				r.max.y = r.min.y+Dy(font->image->r);
-				j = ni;
-				while(--j >= 0){
-					ci = BGSHORT(u);
-					if(ci<0 || ci>=font->nfchar){
-						dst->clipr = clipr;
-						error(Eindex);
-					}
-					r.max.x += font->fchar[ci].width;
-					u += 2;
-				}
 				memdraw(dst, r, bg, q, memopaque, ZP, op);
-				u -= 2*ni;
 			}
-			q = p;
-			while(--ni >= 0){
-				ci = BGSHORT(u);
-				if(ci<0 || ci>=font->nfchar){
-					dst->clipr = clipr;
-					error(Eindex);
-				}
-				q = drawchar(dst, bg, q, src, &sp, font, ci, op);
-				u += 2;
-			}
-			dst->clipr = clipr;
+			q = drawstring(dst, bg, p, src, &sp, font, u, ni, op);
 			p.y -= font->ascent;
+			px = drawarea(Rect(p.x, p.y, q.x, p.y+Dy(font->image->r)), dst->clipr);
+			dst->clipr = clipr;
 			dstflush(dstid, dst, Rect(p.x, p.y, q.x, p.y+Dy(font->image->r)));
 			continue;
 
@@ -2056,11 +3046,12 @@ drawmesg(Client *client, void *av, int n)
 				if(lp[j]->layer->screen != lp[0]->layer->screen)
 					error("images not on same screen");
 			}
+			drawbegin(lp[0]->layer->screen);
 			if(a[1])
 				memltofrontn(lp, nw);
 			else
 				memltorearn(lp, nw);
-			if(screenimage && lp[0]->layer->screen->image->data == screenimage->data)
+			if(tscreen == nil && screenimage && lp[0]->layer->screen->image->data == screenimage->data)
 				for(j=0; j<nw; j++)
 					addflush(lp[j]->layer->screenr);
 			ll = drawlookup(client, BGLONG(a+1+1+2), 1);
@@ -2073,7 +3064,7 @@ drawmesg(Client *client, void *av, int n)
 		case 'v':
 			printmesg(fmt="", a, 0);
 			m = 1;
-			drawflush();
+			drawvisible();
 			continue;
 
 		/* write: 'y' id[4] R[4*4] data[x*1] */
@@ -2090,14 +3081,18 @@ drawmesg(Client *client, void *av, int n)
 			drawrectangle(&r, a+5);
 			if(!rectinrect(r, dst->r))
 				error(Ewriteoutside);
-			y = memload(dst, r, a+m, n-m, *a=='Y');
+			y = drawload(dst, r, a+m, n-m, *a=='Y');
 			if(y < 0)
 				error("bad writeimage call");
+			px = drawarea(r, r);
 			dstflush(dstid, dst, r);
 			m += y;
 			continue;
 		}
 	}
+	if(m > 0)
+		drawcount(&drawstats.op[*a], m, px, t0);
+	mesgunlock(client);
 	poperror();
 }
 
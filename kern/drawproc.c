@@ -0,0 +1,162 @@
+#include	"u.h"
+#include	"lib.h"
+#include	"dat.h"
+#include	"fns.h"
+#include	"error.h"
+
+#define	Image	IMAGE
+#include	<draw.h>
+#include	<memdraw.h>
+#include	"screen.h"
+
+/*
+ * Pool of kprocs that draw bands of large memimagedraw
+ * calls alongside the caller; see memdrawbands in memdraw.h.
+ * The pool size defaults to one less than the number of cpus
+ * and can be set with $DRAWTERM_DRAWPROCS; $DRAWTERM_BANDPIX
+ * sets how many pixels a draw must cover to be split.
+ */
+enum
+{
+	Maxdrawproc	= 7,	/* libmemdraw has only so many scratch buffers */
+};
+
+typedef struct Drawproc Drawproc;
+struct Drawproc
+{
+	Rendez	r;
+	ulong	job;		/* last job seen */
+};
+
+static struct
+{
+	QLock	ql;		/* held by the caller whose job it is */
+	Lock	lk;
+	ulong	job;
+	void	(*fn)(void*, int);
+	void	*arg;
+	int	n;		/* bands in job */
+	int	next;		/* next band to draw */
+	int	done;		/* bands drawn */
+	Rendez	r;		/* caller waits here for done == n */
+	int	nproc;
+	Drawproc	proc[Maxdrawproc];
+} pool;
+
+static void
+runbands(void)
+{
+	int i;
+
+	for(;;){
+		lock(&pool.lk);
+		if(pool.next >= pool.n){
+			unlock(&pool.lk);
+			return;
+		}
+		i = pool.next++;
+		unlock(&pool.lk);
+
+		(*pool.fn)(pool.arg, i);
+
+		lock(&pool.lk);
+		if(++pool.done == pool.n){
+			unlock(&pool.lk);
+			wakeup(&pool.r);
+			return;
+		}
+		unlock(&pool.lk);
+	}
+}
+
+static int
+newjob(void *a)
+{
+	return ((Drawproc*)a)->job != pool.job;
+}
+
+static int
+bandsdone(void *a)
+{
+	USED(a);
+	return pool.done == pool.n;
+}
+
+static void
+drawproc(void *a)
+{
+	Drawproc *p;
+
+	p = a;
+	for(;;){
+		while(waserror())
+			;
+		sleep(&p->r, newjob, p);
+		poperror();
+		p->job = pool.job;
+		runbands();
+	}
+}
+
+static void
+drawbands(void (*fn)(void*, int), void *arg, int n)
+{
+	int i, intr;
+
+	/* the pool is busy with another client's draw; do this one alone */
+	if(!canqlock(&pool.ql)){
+		for(i=0; i<n; i++)
+			(*fn)(arg, i);
+		return;
+	}
+	lock(&pool.lk);
+	pool.fn = fn;
+	pool.arg = arg;
+	pool.n = n;
+	pool.next = 0;
+	pool.done = 0;
+	pool.job++;
+	unlock(&pool.lk);
+	for(i=0; i<pool.nproc && i<n-1; i++)
+		wakeup(&pool.proc[i].r);
+
+	runbands();
+
+	/* the bands are on our stack; wait for them even if interrupted */
+	intr = 0;
+	while(waserror())
+		intr = 1;
+	sleep(&pool.r, bandsdone, nil);
+	poperror();
+	if(intr)
+		up->notepending = 1;
+	qunlock(&pool.ql);
+}
+
+void
+drawprocinit(void)
+{
+	static int didinit;
+	char *s;
+	int i, n;
+
+	if(didinit)
+		return;
+	didinit = 1;
+
+	n = osncpu()-1;
+	if((s = getenv("DRAWTERM_DRAWPROCS")) != nil)
+		n = atoi(s);
+	if(n > Maxdrawproc)
+		n = Maxdrawproc;
+	if((s = getenv("DRAWTERM_BANDPIX")) != nil)
+		memdrawbandpix = atoi(s);
+	if(n <= 0)
+		return;
+
+	pool.nproc = n;
+	for(i=0; i<n; i++)
+		kproc("drawproc", drawproc, &pool.proc[i]);
+	memdrawnband = n+1;
+	memdrawbands = drawbands;
+}
@@ -218,7 +218,9 @@ void		wlock(RWLock*);
 void		wunlock(RWLock*);
 void		osyield(void);
 void		osmsleep(int);
+int		osncpu(void);
 ulong	ticks(void);
+vlong	osnsec(void);
 void	osproc(Proc*);
 void	osnewproc(Proc*);
 void	procsleep(void);
@@ -90,6 +90,15 @@ osyield(void)
 	sched_yield();
 }
 
+int
+osncpu(void)
+{
+	long n;
+
+	n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? n : 1;
+}
+
 void
 oserrstr(void)
 {
@@ -304,6 +313,18 @@ ticks(void)
 	return (t.tv_sec-sec0)*1000+(t.tv_usec-usec0+500)/1000;
 }
 
+/*
+ * Nanoseconds from some fixed time, for measuring intervals.
+ */
+vlong
+osnsec(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (vlong)t.tv_sec*1000000000 + t.tv_nsec;
+}
+
 long
 showfilewrite(char *a, int n)
 {
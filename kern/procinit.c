@@ -4,6 +4,10 @@
 #include "fns.h"
 #include "error.h"
 
+#define	Image	IMAGE
+#include <draw.h>
+#include <memdraw.h>
+
 void
 procinit0(void)
 {
@@ -87,6 +91,7 @@ pexit(char *msg, int freemem)
 	cclose(p->dot);
 	cclose(p->slash);
 
+	memdrawfreebuf();
 	free(p);
 	osexit();
 }
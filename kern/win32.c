@@ -81,6 +81,15 @@ osyield(void)
 	Sleep(0);
 }
 
+int
+osncpu(void)
+{
+	SYSTEM_INFO si;
+
+	GetSystemInfo(&si);
+	return si.dwNumberOfProcessors > 0 ? si.dwNumberOfProcessors : 1;
+}
+
 static DWORD WINAPI
 tramp(LPVOID vp)
 {
@@ -162,6 +171,21 @@ ticks(void)
 	return GetTickCount();
 }
 
+/*
+ * Nanoseconds from some fixed time, for measuring intervals.
+ */
+vlong
+osnsec(void)
+{
+	static LARGE_INTEGER f;
+	LARGE_INTEGER c;
+
+	if(f.QuadPart == 0)
+		QueryPerformanceFrequency(&f);
+	QueryPerformanceCounter(&c);
+	return (vlong)(c.QuadPart/f.QuadPart)*1000000000 + (vlong)(c.QuadPart%f.QuadPart)*1000000000/f.QuadPart;
+}
+
 int
 wstrutflen(Rune *s)
 {
@@ -3,19 +3,32 @@
 #include <draw.h>
 #include <memdraw.h>
 
+/*
+ * Decode straight into the image.  The window the back references
+ * point into is just the output already written, so instead of
+ * keeping a copy of it we find it again in the image: output offset
+ * o is byte o%bpl of row o/bpl of r.  As before, neither literal
+ * runs nor matches may cross the end of a destination line.
+ */
 int
 cloadmemimage(Memimage *i, Rectangle r, uchar *data, int ndata)
 {
-	int y, bpl, c, cnt, offs;
-	uchar mem[NMEM], *memp, *omemp, *emem, *linep, *elinep, *u, *eu;
+	int y, bpl, c, cnt, offs, o, so, n;
+	Memdrawparam par;
+	uchar *linep, *elinep, *u, *eu, *s, *es;
 
 	if(badrect(r) || !rectinrect(r, i->r))
 		return -1;
+
+	memset(&par, 0, sizeof par);
+	par.dst = i;
+	par.r = r;
+	hwdraw(&par);
+
 	bpl = bytesperline(r, i->depth);
 	u = data;
 	eu = data+ndata;
-	memp = mem;
-	emem = mem+NMEM;
+	o = 0;
 	y = r.min.y;
 	linep = byteaddr(i, Pt(r.min.x, y));
 	elinep = linep+bpl;
@@ -26,42 +39,52 @@ cloadmemimage(Memimage *i, Rectangle r, uchar *data, int ndata)
 			linep = byteaddr(i, Pt(r.min.x, y));
 			elinep = linep+bpl;
 		}
-		if(u == eu){	/* buffer too small */
+		if(u == eu)	/* buffer too small */
 			return -1;
-		}
 		c = *u++;
 		if(c >= 128){
-			for(cnt=c-128+1; cnt!=0 ;--cnt){
-				if(u == eu){		/* buffer too small */
-					return -1;
-				}
-				if(linep == elinep){	/* phase error */
-					return -1;
-				}
-				*linep++ = *u;
-				*memp++ = *u++;
-				if(memp == emem)
-					memp = mem;
-			}
-		}
-		else{
-			if(u == eu)	/* short buffer */
+			cnt = c-128+1;
+			if(cnt > eu-u)		/* buffer too small */
 				return -1;
-			offs = *u++ + ((c&3)<<8)+1;
-			if(memp-mem < offs)
-				omemp = memp+(NMEM-offs);
-			else
-				omemp = memp-offs;
-			for(cnt=(c>>2)+NMATCH; cnt!=0; --cnt){
-				if(linep == elinep)	/* phase error */
-					return -1;
-				*linep++ = *omemp;
-				*memp++ = *omemp++;
-				if(omemp == emem)
-					omemp = mem;
-				if(memp == emem)
-					memp = mem;
+			if(cnt > elinep-linep)	/* phase error */
+				return -1;
+			memmove(linep, u, cnt);
+			linep += cnt;
+			u += cnt;
+			o += cnt;
+			continue;
+		}
+		if(u == eu)	/* short buffer */
+			return -1;
+		offs = *u++ + ((c&3)<<8)+1;
+		cnt = (c>>2)+NMATCH;
+		if(cnt > elinep-linep)	/* phase error */
+			return -1;
+		if(offs > o)		/* before the start of the data */
+			return -1;
+		so = o-offs;
+		o += cnt;
+		s = byteaddr(i, Pt(r.min.x, r.min.y+so/bpl)) + so%bpl;
+		es = s + (bpl - so%bpl);
+		while(cnt > 0){
+			if(s == es){	/* source runs on into the next line */
+				s = byteaddr(i, Pt(r.min.x, r.min.y+so/bpl));
+				es = s+bpl;
 			}
+			n = cnt;
+			if(n > es-s)
+				n = es-s;
+			cnt -= n;
+			so += n;
+			/*
+			 * Copy forward; when the source is at least a word
+			 * behind, whole words never read what they write.
+			 */
+			if(offs >= 8)
+				for(; n >= 8; n -= 8, s += 8, linep += 8)
+					memmove(linep, s, 8);
+			for(; n > 0; n--)
+				*linep++ = *s++;
 		}
 	}
 	return u-data;
@@ -37,8 +37,9 @@
 	 (CALC22(a1, (rgba1>>8) & MASK, a2, (rgba2>>8) & MASK, tmp2)<<8))
 
 static void mktables(void);
+static void alphacalcinit(void);
 typedef int Subdraw(Memdrawparam*);
-static Subdraw chardraw, alphadraw, memoptdraw;
+static Subdraw chardraw, alphadraw, fastdraw, memoptdraw;
 
 static Memimage*	memones;
 static Memimage*	memzeros;
@@ -47,6 +48,11 @@ Memimage *memblack;
 Memimage *memtransparent;
 Memimage *memopaque;
 
+int	memdrawnband;
+int	memdrawbandpix = 256*1024;
+void	(*memdrawbands)(void (*)(void*, int), void*, int);
+void	(*memdrawtrace)(Memdrawparam*, char*);
+
 int	_ifmt(Fmt*);
 
 int
@@ -58,6 +64,7 @@ memimageinit(void)
 		return 0;
 
 	mktables();
+	alphacalcinit();
 	_memmkcmap();
 
 	fmtinstall('R', Rfmt); 
@@ -88,89 +95,172 @@ memimageinit(void)
 static ulong imgtorgba(Memimage*, ulong);
 static ulong rgbatoimg(Memimage*, ulong);
 static ulong pixelbits(Memimage*, Point);
+static int banddraw(Memdrawparam*, Subdraw*);
+static char *fastpath(Memdrawparam*);
 
-void
-memimagedraw(Memimage *dst, Rectangle r, Memimage *src, Point p0, Memimage *mask, Point p1, int op)
+/*
+ * Work out what we can about src and mask before drawing.
+ * Return zero if the draw is a no-op.
+ */
+static int
+drawstate(Memdrawparam *par)
 {
-	Memdrawparam par;
-
-	if(mask == nil)
-		mask = memopaque;
+	Memimage *src, *mask;
+	int op;
 
-	if(drawclip(dst, &r, src, &p0, mask, &p1, &par.sr, &par.mr) == 0)
-		return;
-
-	if(op < Clear || op > SoverD)
-		return;
-
-	par.op = op;
-	par.dst = dst;
-	par.r = r;
-	par.src = src;
-	/* par.sr set by drawclip */
-	par.mask = mask;
-	/* par.mr set by drawclip */
-
-	par.state = 0;
+	src = par->src;
+	mask = par->mask;
+	op = par->op;
+	par->state = 0;
 	if(src->flags&Frepl){
-		par.state |= Replsrc;
+		par->state |= Replsrc;
 		if(Dx(src->r)==1 && Dy(src->r)==1){
-			par.sval = pixelbits(src, src->r.min);
-			par.state |= Simplesrc;
-			par.srgba = imgtorgba(src, par.sval);
-			par.sdval = rgbatoimg(dst, par.srgba);
-			if((par.srgba&0xFF) == 0 && (op&DoutS))
-				return;	/* no-op successfully handled */
+			par->sval = pixelbits(src, src->r.min);
+			par->state |= Simplesrc;
+			par->srgba = imgtorgba(src, par->sval);
+			par->sdval = rgbatoimg(par->dst, par->srgba);
+			if((par->srgba&0xFF) == 0 && (op&DoutS))
+				return 0;	/* no-op successfully handled */
 		}
 	}
 
 	if(mask->flags & Frepl){
-		par.state |= Replmask;
+		par->state |= Replmask;
 		if(Dx(mask->r)==1 && Dy(mask->r)==1){
-			par.mval = pixelbits(mask, mask->r.min);
-			if(par.mval == 0 && (op&DoutS))
-				return;	/* no-op successfully handled */
-			par.state |= Simplemask;
-			if(par.mval == ~0)
-				par.state |= Fullmask;
-			par.mrgba = imgtorgba(mask, par.mval);
+			par->mval = pixelbits(mask, mask->r.min);
+			if(par->mval == 0 && (op&DoutS))
+				return 0;	/* no-op successfully handled */
+			par->state |= Simplemask;
+			if(par->mval == ~0)
+				par->state |= Fullmask;
+			par->mrgba = imgtorgba(mask, par->mval);
 		}
 	}
+	return 1;
+}
 
-	/*
-	 * Now that we've clipped the parameters down to be consistent, we 
-	 * simply try sub-drawing routines in order until we find one that was able
-	 * to handle us.  If the sub-drawing routine returns zero, it means it was
-	 * unable to satisfy the request, so we do not return.
-	 */
+/*
+ * Now that we've clipped the parameters down to be consistent, we 
+ * simply try sub-drawing routines in order until we find one that was able
+ * to handle us.  If the sub-drawing routine returns zero, it means it was
+ * unable to satisfy the request, so we do not return.
+ * Return the name of the path that did the work.
+ */
+static char*
+drawpar(Memdrawparam *par)
+{
+	char *path;
 
 	/*
 	 * Hardware support.  Each video driver provides this function,
 	 * which checks to see if there is anything it can help with.
 	 * There could be an if around this checking to see if dst is in video memory.
 	 */
-	if(hwdraw(&par))
-		return;
+	if(hwdraw(par))
+		return "hw";
 
 	/*
 	 * Optimizations using memmove and memset.
 	 */
-	if(memoptdraw(&par))
-		return;
+	if(memoptdraw(par))
+		return "opt";
 
 	/*
 	 * Character drawing.
 	 * Solid source color being painted through a boolean mask onto a high res image.
 	 */
-	if(chardraw(&par))
-		return;
+	if(chardraw(par))
+		return "char";
 
 	/*
-	 * General calculation-laden case that does alpha for each pixel.
+	 * Direct kernels for common combinations of channels,
+	 * mask and op, skipping the intermediate buffers.
 	 */
-	alphadraw(&par);
+	if((path = fastpath(par)) != nil){
+		banddraw(par, fastdraw);
+		return path;
+	}
+
+	/*
+	 * General calculation-laden case that does alpha for each pixel,
+	 * in parallel bands of scan lines if the draw is big enough.
+	 */
+	banddraw(par, alphadraw);
+	return "alpha";
 }
 
+void
+memimagedraw(Memimage *dst, Rectangle r, Memimage *src, Point p0, Memimage *mask, Point p1, int op)
+{
+	Memdrawparam par;
+	char *path;
+
+	if(mask == nil)
+		mask = memopaque;
+
+	if(drawclip(dst, &r, src, &p0, mask, &p1, &par.sr, &par.mr) == 0)
+		return;
+
+	if(op < Clear || op > SoverD)
+		return;
+
+	par.op = op;
+	par.dst = dst;
+	par.r = r;
+	par.src = src;
+	/* par.sr set by drawclip */
+	par.mask = mask;
+	/* par.mr set by drawclip */
+
+	if(!drawstate(&par))
+		return;
+	path = drawpar(&par);
+	if(memdrawtrace != nil)
+		memdrawtrace(&par, path);
+}
+
+/*
+ * Draw a run of glyphs from the same src through the same mask,
+ * as memimagedraw(dst, g->r+delta, src, g->sp, mask, g->mp, op) would
+ * for each, within clipr.  The src and mask state is worked out once
+ * for the whole run.  See memglyphs.
+ */
+void
+_memimageglyphs(Memimage *dst, Rectangle clipr, Point delta, Memimage *src, Memimage *mask, Memglyph *g, int n, int op)
+{
+	Memdrawparam par;
+	Rectangle r;
+	Point p0, p1, rmin;
+	char *path;
+
+	if(mask == nil)
+		mask = memopaque;
+
+	if(op < Clear || op > SoverD)
+		return;
+
+	par.op = op;
+	par.dst = dst;
+	par.src = src;
+	par.mask = mask;
+	if(!drawstate(&par))
+		return;
+
+	for(; n > 0; n--, g++){
+		r = rectaddpt(g->r, delta);
+		rmin = r.min;
+		if(!rectclip(&r, clipr))
+			continue;
+		p0 = addpt(g->sp, subpt(r.min, rmin));
+		p1 = addpt(g->mp, subpt(r.min, rmin));
+		if(drawclip(dst, &r, src, &p0, mask, &p1, &par.sr, &par.mr) == 0)
+			continue;
+		par.r = r;
+		path = drawpar(&par);
+		if(memdrawtrace != nil)
+			memdrawtrace(&par, path);
+	}
+}
 
 /*
  * Clip the destination rectangle further based on the properties of the 
@@ -464,22 +554,55 @@ static Calcfn *boolcalc[Ncomp] =
 	boolcalc1011,		/* SoverD */
 };
 
+/* SoverD with no source alpha; alphacalcinit may replace it */
+static Calcfn *soverdcalc = alphacalcS;
+
 /*
- * Avoid standard Lock, QLock so that can be used in kernel.
+ * Scratch space for alphadraw: its Params and the buffers scan
+ * lines are read and converted into.  Each thread gets a Dbuf of
+ * its own the first time it draws.  The buffer only ever grows, to
+ * the most any draw on that thread has needed, and is aligned for
+ * vector loads, so once warmed up drawing does not call malloc.
+ * Compilers without thread-local storage share a few Dbufs, taken
+ * with tas rather than Lock or QLock so this can be used in the kernel.
  */
+enum {
+	Dbufalign = 64,
+};
+
 typedef struct Dbuf Dbuf;
 struct Dbuf
 {
-	uchar *p;
+	uchar *p;		/* Dbufalign aligned */
+	uchar *alloc;
 	int n;
 	Param spar, mpar, dpar;
 	int inuse;
 };
+
+#if defined(__GNUC__)
+#define DBUFTLS
+static __thread Dbuf *tdbuf;
+#else
 static Dbuf dbuf[10];
+#endif
 
 static Dbuf*
 allocdbuf(void)
 {
+#ifdef DBUFTLS
+	Dbuf *z;
+
+	if((z = tdbuf) == nil){
+		if((z = mallocz(sizeof *z, 1)) == nil)
+			return nil;
+		tdbuf = z;
+	}
+	if(z->inuse)
+		return nil;
+	z->inuse = 1;
+	return z;
+#else
 	int i;
 
 	for(i=0; i<nelem(dbuf); i++){
@@ -489,6 +612,52 @@ allocdbuf(void)
 			return &dbuf[i];
 	}
 	return nil;
+#endif
+}
+
+static int
+growdbuf(Dbuf *z, int n)
+{
+	uchar *p;
+
+	if(z->n >= n)
+		return 0;
+	n = (n+4095) & ~4095;
+	if((p = malloc(n+Dbufalign-1)) == nil)
+		return -1;
+	free(z->alloc);
+	z->alloc = p;
+	z->p = (uchar*)(((uintptr)p+Dbufalign-1) & ~(uintptr)(Dbufalign-1));
+	z->n = n;
+	return 0;
+}
+
+/*
+ * Free the calling thread's scratch space.
+ */
+void
+memdrawfreebuf(void)
+{
+#ifdef DBUFTLS
+	Dbuf *z;
+
+	_memfreebrush();
+	if((z = tdbuf) == nil)
+		return;
+	tdbuf = nil;
+	free(z->alloc);
+	free(z);
+#endif
+}
+
+static int
+dbufoff(int *ndrawbuf, int n)
+{
+	int off;
+
+	off = (*ndrawbuf+Dbufalign-1) & ~(Dbufalign-1);
+	*ndrawbuf = off+n;
+	return off;
 }
 
 static void
@@ -522,8 +691,7 @@ getparam(Param *p, Memimage *img, Rectangle r, int convgrey, int needbuf, int *n
 		nbuf = Dy(img->r);
 	}
 	p->bufdelta = 4*p->dx;
-	p->bufoff = *ndrawbuf;
-	*ndrawbuf += p->bufdelta*nbuf;
+	p->bufoff = dbufoff(ndrawbuf, p->bufdelta*nbuf);
 }
 
 static void
@@ -653,7 +821,7 @@ alphadraw(Memdrawparam *par)
 			if(mask->chan == GREY1 && !(src->flags&Falpha))
 				calc = boolcalc[op];
 			else if(op == SoverD && !(src->flags&Falpha))
-				calc = alphacalcS;
+				calc = soverdcalc;
 		}
 	}
 
@@ -670,13 +838,9 @@ alphadraw(Memdrawparam *par)
 		rdmask = replread;
 	}
 
-	if(z->n < ndrawbuf){
-		free(z->p);
-		if((z->p = mallocz(ndrawbuf, 0)) == nil){
-			z->inuse = 0;
-			return 0;
-		}
-		z->n = ndrawbuf;
+	if(growdbuf(z, ndrawbuf) < 0){
+		z->inuse = 0;
+		return 0;
 	}
 	drawbuf = z->p;
 
@@ -727,6 +891,74 @@ alphadraw(Memdrawparam *par)
 	return 1;
 }
 
+/*
+ * Split a large alphadraw or fastdraw into horizontal bands and
+ * hand them to memdrawbands.  Each alphadraw band uses the Dbuf of
+ * the thread drawing it; a band that can't get one returns zero
+ * and is redrawn here afterwards.  Bands must not overlap in what they read and
+ * write, so draws whose source or mask is the destination are
+ * done in one piece.
+ */
+enum {
+	Maxband = 8,	/* without DBUFTLS, leave some dbufs for other callers */
+	Minbandy = 16,	/* scan lines */
+};
+
+typedef struct Band Band;
+struct Band
+{
+	Memdrawparam par;
+	Subdraw *draw;
+	int ok;
+};
+
+static void
+drawband(void *a, int i)
+{
+	Band *b;
+
+	b = (Band*)a + i;
+	b->ok = (*b->draw)(&b->par);
+}
+
+static int
+banddraw(Memdrawparam *par, Subdraw *draw)
+{
+	Band band[Maxband];
+	int i, n, y, dy, ny;
+
+	dy = Dy(par->r);
+	n = memdrawnband;
+	if(n > Maxband)
+		n = Maxband;
+	if(n > dy/Minbandy)
+		n = dy/Minbandy;
+	if(memdrawbands == nil || n < 2 || memdrawbandpix <= 0
+	|| (vlong)Dx(par->r)*dy < memdrawbandpix
+	|| par->src->data == par->dst->data || par->mask->data == par->dst->data)
+		return (*draw)(par);
+
+	y = 0;
+	for(i=0; i<n; i++){
+		ny = (dy-y)/(n-i);
+		band[i].par = *par;
+		band[i].par.r.min.y += y;
+		band[i].par.r.max.y = band[i].par.r.min.y+ny;
+		band[i].par.sr.min.y += y;
+		band[i].par.sr.max.y = band[i].par.sr.min.y+ny;
+		band[i].par.mr.min.y += y;
+		band[i].par.mr.max.y = band[i].par.mr.min.y+ny;
+		band[i].draw = draw;
+		band[i].ok = 0;
+		y += ny;
+	}
+	memdrawbands(drawband, band, n);
+	for(i=0; i<n; i++)
+		if(!band[i].ok && !(*draw)(&band[i].par))
+			return 0;
+	return 1;
+}
+
 static void
 alphacalc0(Buffer bdst, Buffer b1, Buffer b2, int dx, int grey, int op)
 {
@@ -833,11 +1065,12 @@ alphacalc14(Buffer bdst, Buffer bsrc, Buffer bmask, int dx, int grey, int op)
 static void
 alphacalc2810(Buffer bdst, Buffer bsrc, Buffer bmask, int dx, int grey, int op)
 {
-	int fs, sadelta;
+	int fs, sadelta, dadelta;
 	int i, ma, da, q;
 	ulong t, t1;
 
 	sadelta = bsrc.alpha == &ones ? 0 : bsrc.delta;
+	dadelta = bdst.alpha == &ones ? 0 : bdst.delta;
 	q = bsrc.delta == 4 && bdst.delta == 4 && chanmatch(&bdst, &bsrc);
 
 	for(i=0; i<dx; i++){
@@ -859,7 +1092,7 @@ alphacalc2810(Buffer bdst, Buffer bsrc, Buffer bmask, int dx, int grey, int op)
 				bsrc.rgba++;
 				bdst.rgba++;
 				bmask.alpha += bmask.delta;
-				bdst.alpha += bdst.delta;
+				bdst.alpha += dadelta;
 				continue;
 			}
 			*bdst.red = CALC11(fs, *bsrc.red, t);
@@ -884,11 +1117,12 @@ alphacalc2810(Buffer bdst, Buffer bsrc, Buffer bmask, int dx, int grey, int op)
 static void
 alphacalc3679(Buffer bdst, Buffer bsrc, Buffer bmask, int dx, int grey, int op)
 {
-	int fs, fd, sadelta;
+	int fs, fd, sadelta, dadelta;
 	int i, sa, ma, da, q;
 	ulong t, t1;
 
 	sadelta = bsrc.alpha == &ones ? 0 : bsrc.delta;
+	dadelta = bdst.alpha == &ones ? 0 : bdst.delta;
 	q = bsrc.delta == 4 && bdst.delta == 4 && chanmatch(&bdst, &bsrc);
 
 	for(i=0; i<dx; i++){
@@ -918,7 +1152,7 @@ alphacalc3679(Buffer bdst, Buffer bsrc, Buffer bmask, int dx, int grey, int op)
 				bdst.rgba++;
 				bsrc.alpha += sadelta;
 				bmask.alpha += bmask.delta;
-				bdst.alpha += bdst.delta;
+				bdst.alpha += dadelta;
 				continue;
 			}
 			*bdst.red = CALC12(fs, *bsrc.red, fd, *bdst.red, t);
@@ -1072,6 +1306,382 @@ alphacalcS(Buffer bdst, Buffer bsrc, Buffer bmask, int dx, int grey, int op)
 	}
 }
 
+/*
+ * Vector versions of the word-at-a-time (q) paths of the alpha
+ * calculators and of alphacalcS.  They are written once using the
+ * GCC vector extensions, NV pixels at a time, and compiled both for
+ * the baseline instruction set (SSE2 on amd64, NEON on arm) and, on
+ * x86, for AVX2; alphacalcinit picks one at run time.  The arithmetic
+ * is the same 32-bit CALC2x/CALC4x arithmetic done by the scalar code,
+ * carries between the 16-bit halves included, so the results are
+ * bit-identical.  Whatever a vector loop cannot handle (grey images,
+ * mismatched channels, the last dx%NV pixels) is left to the scalar
+ * calculator.
+ */
+#if defined(__GNUC__) && !defined(NOSIMD) && (defined(__SSE2__) || defined(__ARM_NEON))
+#define SIMDCALC
+
+enum {
+	NV = 8,
+};
+
+/* the helpers are all inlined, so wide vectors never cross a call */
+#if !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+typedef ulong	Vec __attribute__((vector_size(4*NV)));
+typedef ushort	Vec16 __attribute__((vector_size(4*NV)));
+
+#define VINLINE	static inline __attribute__((always_inline))
+
+/*
+ * The CALC macros over vectors of pixel words.  The multiplies are
+ * done on 16-bit halves, which is exact since both factors are < 256.
+ */
+#define VMUL2(a, vvuu) \
+	((Vec)((Vec16)((a) | (a)<<16)*(Vec16)(vvuu)))
+
+#define VCALC11(a, v, tmp) \
+	(tmp=(Vec)((Vec16)(a)*(Vec16)(v))+128, (tmp+(tmp>>8))>>8)
+
+#define VCALC21(a, vvuu, tmp) \
+	(tmp=VMUL2(a, vvuu)+0x00800080, ((tmp+((tmp>>8)&MASK))>>8)&MASK)
+
+#define VCALC41(a, rgba, tmp1, tmp2) \
+	(VCALC21(a, (rgba) & MASK, tmp1) | \
+	 (VCALC21(a, ((rgba)>>8)&MASK, tmp2)<<8))
+
+#define VCALC22(a1, vvuu1, a2, vvuu2, tmp) \
+	(tmp=VMUL2(a1, vvuu1)+VMUL2(a2, vvuu2)+0x00800080, ((tmp+((tmp>>8)&MASK))>>8)&MASK)
+
+#define VCALC42(a1, rgba1, a2, rgba2, tmp1, tmp2) \
+	(VCALC22(a1, (rgba1) & MASK, a2, (rgba2) & MASK, tmp1) | \
+	 (VCALC22(a1, ((rgba1)>>8) & MASK, a2, ((rgba2)>>8) & MASK, tmp2)<<8))
+
+VINLINE Vec
+vload(ulong *p)
+{
+	Vec v;
+
+	memmove(&v, p, sizeof v);
+	return v;
+}
+
+
+/* gather NV bytes that are delta apart */
+VINLINE Vec
+vbytes(uchar *p, int delta)
+{
+	Vec v;
+	int i;
+
+#if defined(__clang__) || __GNUC__ >= 9
+	if(delta == 1){
+		uchar b __attribute__((vector_size(NV)));
+
+		memmove(&b, p, NV);
+		return __builtin_convertvector(b, Vec);
+	}
+#endif
+	for(i=0; i<NV; i++)
+		v[i] = p[i*delta];
+	return v;
+}
+
+/*
+ * Byte offset of channel c within the pixel word of b,
+ * or -1 if it does not live there.
+ */
+static int
+wordoff(Buffer *b, uchar *c)
+{
+	long off;
+
+	if(b->rgba == nil || c == nil || c == &ones)
+		return -1;
+	off = c - (uchar*)b->rgba;
+	if(off < 0 || off >= 4)
+		return -1;
+	return off;
+}
+
+/*
+ * Can the q path of the alpha calculators be done on vectors?
+ * Sets *soff to the offset of source alpha in the source word,
+ * -1 if the source has no alpha.
+ */
+static int
+vwordcalc(Buffer *bdst, Buffer *bsrc, int grey, int *soff)
+{
+	if(grey || bsrc->delta != 4 || bdst->delta != 4 || !chanmatch(bdst, bsrc))
+		return 0;
+	*soff = -1;
+	if(bsrc->alpha != &ones && (*soff = wordoff(bsrc, bsrc->alpha)) < 0)
+		return 0;
+	return 1;
+}
+
+/* the alpha bytes at off in each word, all 255 if off < 0 */
+#define valpha(rgba, off) \
+	((off) < 0 ? (Vec){} + 255 : ((rgba) >> 8*(off)) & 0xFF)
+
+/* step the buffer pointers over n pixels */
+static void
+bufskip(Buffer *b, int n)
+{
+	n *= b->delta;
+	if(b->red)
+		b->red += n;
+	if(b->grn)
+		b->grn += n;
+	if(b->blu)
+		b->blu += n;
+	if(b->grey)
+		b->grey += n;
+	if(b->rgba)
+		b->rgba = (ulong*)((uchar*)b->rgba + n);
+	if(b->alpha != &ones)
+		b->alpha += n;
+}
+
+VINLINE void
+valphacalc14(Buffer bdst, Buffer bsrc, Buffer bmask, int dx, int grey, int op)
+{
+	int n, soff;
+	Vec fd, sa, ma, d, t, t1;
+
+	n = 0;
+	if(vwordcalc(&bdst, &bsrc, grey, &soff)){
+		for(n=0; n+NV<=dx; n+=NV){
+			sa = valpha(vload(bsrc.rgba+n), soff);
+			ma = vbytes(bmask.alpha+n*bmask.delta, bmask.delta);
+			fd = VCALC11(sa, ma, t);
+			if(op == DoutS)
+				fd = 255-fd;
+			d = vload(bdst.rgba+n);
+			d = VCALC41(fd, d, t, t1);
+			memmove(bdst.rgba+n, &d, sizeof d);
+		}
+		if(n == dx)
+			return;
+		bufskip(&bsrc, n);
+		bufskip(&bdst, n);
+		bufskip(&bmask, n);
+	}
+	alphacalc14(bdst, bsrc, bmask, dx-n, grey, op);
+}
+
+VINLINE void
+valphacalc2810(Buffer bdst, Buffer bsrc, Buffer bmask, int dx, int grey, int op)
+{
+	int n, soff, doff;
+	Vec fs, da, s, t, t1;
+
+	n = 0;
+	doff = wordoff(&bdst, bdst.alpha);
+	if(vwordcalc(&bdst, &bsrc, grey, &soff)){
+		for(n=0; n+NV<=dx; n+=NV){
+			fs = vbytes(bmask.alpha+n*bmask.delta, bmask.delta);
+			if(op != S){
+				da = valpha(vload(bdst.rgba+n), doff);
+				if(op == SoutD)
+					da = 255-da;
+				fs = VCALC11(fs, da, t);
+			}
+			s = vload(bsrc.rgba+n);
+			s = VCALC41(fs, s, t, t1);
+			memmove(bdst.rgba+n, &s, sizeof s);
+		}
+		if(n == dx)
+			return;
+		bufskip(&bsrc, n);
+		bufskip(&bdst, n);
+		bufskip(&bmask, n);
+	}
+	alphacalc2810(bdst, bsrc, bmask, dx-n, grey, op);
+}
+
+VINLINE void
+valphacalc3679(Buffer bdst, Buffer bsrc, Buffer bmask, int dx, int grey, int op)
+{
+	int n, soff, doff;
+	Vec fs, fd, ma, da, s, d, t, t1;
+
+	n = 0;
+	doff = wordoff(&bdst, bdst.alpha);
+	if(vwordcalc(&bdst, &bsrc, grey, &soff)){
+		for(n=0; n+NV<=dx; n+=NV){
+			s = vload(bsrc.rgba+n);
+			d = vload(bdst.rgba+n);
+			ma = vbytes(bmask.alpha+n*bmask.delta, bmask.delta);
+			da = valpha(d, doff);
+			if(op == SatopD)
+				fs = VCALC11(ma, da, t);
+			else
+				fs = VCALC11(ma, 255-da, t);
+			if(op == DoverS)
+				fd = (Vec){} + 255;
+			else{
+				fd = valpha(s, soff);
+				fd = VCALC11(fd, ma, t);
+				if(op != DatopS)
+					fd = 255-fd;
+			}
+			d = VCALC42(fs, s, fd, d, t, t1);
+			memmove(bdst.rgba+n, &d, sizeof d);
+		}
+		if(n == dx)
+			return;
+		bufskip(&bsrc, n);
+		bufskip(&bdst, n);
+		bufskip(&bmask, n);
+	}
+	alphacalc3679(bdst, bsrc, bmask, dx-n, grey, op);
+}
+
+VINLINE void
+valphacalc11(Buffer bdst, Buffer bsrc, Buffer bmask, int dx, int grey, int op)
+{
+	int n, soff;
+	Vec fd, sa, ma, s, d, t, t1;
+
+	n = 0;
+	if(vwordcalc(&bdst, &bsrc, grey, &soff)){
+		for(n=0; n+NV<=dx; n+=NV){
+			s = vload(bsrc.rgba+n);
+			ma = vbytes(bmask.alpha+n*bmask.delta, bmask.delta);
+			sa = valpha(s, soff);
+			fd = 255-VCALC11(sa, ma, t);
+			d = vload(bdst.rgba+n);
+			d = VCALC42(ma, s, fd, d, t, t1);
+			memmove(bdst.rgba+n, &d, sizeof d);
+		}
+		if(n == dx)
+			return;
+		bufskip(&bsrc, n);
+		bufskip(&bdst, n);
+		bufskip(&bmask, n);
+	}
+	alphacalc11(bdst, bsrc, bmask, dx-n, grey, op);
+}
+
+/*
+ * alphacalcS does its colour channels one byte at a time,
+ * but since ma+fd == 255 the 16-bit halves of CALC42 cannot
+ * carry into each other and it gives the same answer.
+ */
+VINLINE void
+valphacalcS(Buffer bdst, Buffer bsrc, Buffer bmask, int dx, int grey, int op)
+{
+	int n, roff, goff, boff, aoff;
+	ulong cmask;
+	Vec fd, ma, s, d, a, t, t1;
+
+	n = 0;
+	roff = wordoff(&bdst, bdst.red);
+	goff = wordoff(&bdst, bdst.grn);
+	boff = wordoff(&bdst, bdst.blu);
+	aoff = wordoff(&bdst, bdst.alpha);
+	if(!grey && bsrc.delta == 4 && bdst.delta == 4
+	&& roff >= 0 && goff >= 0 && boff >= 0
+	&& roff == wordoff(&bsrc, bsrc.red)
+	&& goff == wordoff(&bsrc, bsrc.grn)
+	&& boff == wordoff(&bsrc, bsrc.blu)
+	&& (bdst.alpha == &ones || aoff >= 0)){
+		cmask = 0xFF<<8*roff | 0xFF<<8*goff | 0xFF<<8*boff;
+		for(n=0; n+NV<=dx; n+=NV){
+			ma = vbytes(bmask.alpha+n*bmask.delta, bmask.delta);
+			fd = 255-ma;
+			d = vload(bdst.rgba+n);
+			if(aoff >= 0){
+				a = valpha(d, aoff);
+				a = (ma+VCALC11(fd, a, t)) << 8*aoff;
+			}else
+				a = d & ~cmask;
+			s = vload(bsrc.rgba+n);
+			d = (VCALC42(ma, s, fd, d, t, t1) & cmask) | a;
+			memmove(bdst.rgba+n, &d, sizeof d);
+		}
+		if(n == dx)
+			return;
+		bufskip(&bsrc, n);
+		bufskip(&bdst, n);
+		bufskip(&bmask, n);
+	}
+	alphacalcS(bdst, bsrc, bmask, dx-n, grey, op);
+}
+
+/*
+ * One copy of each calculator for the baseline vector unit
+ * and, on x86, one more for AVX2.
+ */
+#define VCALCFN(name, attr) \
+	static attr void name##vec(Buffer bdst, Buffer bsrc, Buffer bmask, int dx, int grey, int op) \
+	{ v##name(bdst, bsrc, bmask, dx, grey, op); }
+
+VCALCFN(alphacalc14, )
+VCALCFN(alphacalc2810, )
+VCALCFN(alphacalc3679, )
+VCALCFN(alphacalc11, )
+VCALCFN(alphacalcS, )
+
+#if defined(__x86_64__) || defined(__i386__)
+#define AVX2CALC
+#define AVX2	__attribute__((target("avx2")))
+#define VCALCAVX2(name) \
+	static AVX2 void name##avx2(Buffer bdst, Buffer bsrc, Buffer bmask, int dx, int grey, int op) \
+	{ v##name(bdst, bsrc, bmask, dx, grey, op); }
+
+VCALCAVX2(alphacalc14)
+VCALCAVX2(alphacalc2810)
+VCALCAVX2(alphacalc3679)
+VCALCAVX2(alphacalc11)
+VCALCAVX2(alphacalcS)
+#endif
+
+#endif /* SIMDCALC */
+
+/*
+ * Replace the scalar calculators with the best vector
+ * versions this processor can run.
+ */
+static void
+alphacalcinit(void)
+{
+#ifdef SIMDCALC
+	Calcfn *c14, *c2810, *c3679, *c11, *cS;
+	int i;
+
+	c14 = alphacalc14vec;
+	c2810 = alphacalc2810vec;
+	c3679 = alphacalc3679vec;
+	c11 = alphacalc11vec;
+	cS = alphacalcSvec;
+#ifdef AVX2CALC
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2")){
+		c14 = alphacalc14avx2;
+		c2810 = alphacalc2810avx2;
+		c3679 = alphacalc3679avx2;
+		c11 = alphacalc11avx2;
+		cS = alphacalcSavx2;
+	}
+#endif
+	for(i=0; i<Ncomp; i++){
+		if(alphacalc[i] == alphacalc14)
+			alphacalc[i] = c14;
+		else if(alphacalc[i] == alphacalc2810)
+			alphacalc[i] = c2810;
+		else if(alphacalc[i] == alphacalc3679)
+			alphacalc[i] = c3679;
+		else if(alphacalc[i] == alphacalc11)
+			alphacalc[i] = c11;
+	}
+	soverdcalc = cS;
+#endif
+}
+
 static void
 boolcalc14(Buffer bdst, Buffer b1, Buffer bmask, int dx, int grey, int op)
 {
@@ -1776,11 +2386,15 @@ genconv(Param *p, uchar *buf, int y)
 	/* read from source into RGB format in convbuf */
 	b = p->convreadcall(p, p->convbuf, y);
 
-	/* write RGB format into dst format in buf */
+	/*
+	 * write RGB format into dst format in buf,
+	 * with bits no channel covers (the x of XRGB32) zero
+	 */
+	nb = p->convdpar->img->depth/8;
+	memset(buf, 0, nb*p->dx);
 	p->convwritecall(p->convdpar, buf, b);
 
 	if(p->convdx){
-		nb = p->convdpar->img->depth/8;
 		r = buf;
 		w = buf+nb*p->dx;
 		ew = buf+nb*p->convdx;
@@ -1813,8 +2427,7 @@ convfn(Memimage *dst, Param *dpar, Memimage *src, Param *spar, int *ndrawbuf)
 	spar->convdpar = dpar;
 
 	/* allocate a conversion buffer */
-	spar->convbufoff = *ndrawbuf;
-	*ndrawbuf += spar->dx*4;
+	spar->convbufoff = dbufoff(ndrawbuf, spar->dx*4);
 
 	if(spar->dx > Dx(spar->img->r)){
 		spar->convdx = spar->dx;
@@ -2381,6 +2994,294 @@ chardraw(Memdrawparam *par)
 	return 1;	
 }
 
+/*
+ * Fast paths.  Direct span kernels for the combinations of
+ * source channel, mask and op that dominate screen drawing,
+ * computing the same values as alphadraw without converting
+ * through the intermediate buffers.  Only XRGB32 destinations
+ * are handled.
+ *
+ * The pad byte of XRGB32 is written as alphadraw leaves it,
+ * which depends on the path alphadraw takes:
+ *	- a 32-bit source that is not replicated is combined a
+ *	  word at a time, so its fourth byte is carried along as
+ *	  though it were alpha (OPSW, OPSOVERDW);
+ *	- the boolean SoverD copy of a source without alpha takes
+ *	  the source's pad as is, or 0 if the source had to be
+ *	  converted first (Pcopy, Pzero);
+ *	- otherwise the pad is left alone (Pkeep).
+ */
+typedef struct Span Span;
+struct Span
+{
+	uchar	*d;		/* destination pixels */
+	uchar	*s;		/* source pixels */
+	int	sdelta;	/* bytes between source pixels; 0 for a 1-pixel repl */
+	uchar	*m;		/* mask pixels */
+	int	mdelta;	/* 1, or 0 for a 1-pixel repl mask */
+	int	mbit;		/* GREY1 masks: bit number of the first pixel in *m */
+	uchar	*cmap;	/* CMAP8 sources: cmap2rgb */
+	int	dx;
+};
+typedef void Spanfn(Span*);
+
+enum {
+	Mopaque,
+	Mgrey1,
+	Mgrey8,
+};
+
+/* source readers: set r, g, b, sa and the fourth byte x from s */
+#define	SXRGB32	b = s[0], g = s[1], r = s[2], sa = 255, x = s[3]
+#define	SARGB32	b = s[0], g = s[1], r = s[2], sa = s[3], x = sa
+#define	SRGB24	b = s[0], g = s[1], r = s[2], sa = 255, x = 0
+#define	SGREY8	b = g = r = s[0], sa = 255, x = 0
+#define	SCMAP8	q = cmap+3*s[0], r = q[0], g = q[1], b = q[2], sa = 255, x = 0
+
+/* mask readers: set ma */
+#define	MOPAQUE	ma = 255
+#define	MGREY1	ma = (m[bit>>3]>>(7-(bit&7)))&1 ? 255 : 0, bit += mdelta
+#define	MGREY8	ma = *m, m += mdelta
+
+/* ops: combine into d; SoverD leaves d alone where ma is 0 */
+#define	OPS \
+	if(ma == 255){ \
+		d[0] = b; \
+		d[1] = g; \
+		d[2] = r; \
+	}else{ \
+		d[0] = CALC11(ma, b, t); \
+		d[1] = CALC11(ma, g, t); \
+		d[2] = CALC11(ma, r, t); \
+	}
+#define	OPSOVERD \
+	if(ma == 0) \
+		continue; \
+	fd = 255 - (sa == 255 ? ma : ma == 255 ? sa : CALC11(sa, ma, t)); \
+	if(fd == 0){ \
+		d[0] = b; \
+		d[1] = g; \
+		d[2] = r; \
+	}else{ \
+		d[0] = CALC12(ma, b, fd, d[0], t); \
+		d[1] = CALC12(ma, g, fd, d[1], t); \
+		d[2] = CALC12(ma, r, fd, d[2], t); \
+	}
+
+/* the same, a word at a time with the fourth byte as alpha, as alphadraw does */
+#define	OPSW \
+	*(ulong*)d = ma == 255 ? *(ulong*)s : CALC41(ma, *(ulong*)s, t, t1);
+#define	OPSOVERDW \
+	if(ma == 0) \
+		continue; \
+	fd = 255 - (sa == 255 ? ma : ma == 255 ? sa : CALC11(sa, ma, t)); \
+	*(ulong*)d = fd == 0 ? *(ulong*)s : CALC42(ma, *(ulong*)s, fd, *(ulong*)d, t, t1);
+
+/* pad byte, after a three-byte op */
+#define	Pkeep
+#define	Pcopy	if(ma != 0) d[3] = x
+#define	Pzero	if(ma != 0) d[3] = 0
+
+#define	SPANFN(name, SRC, MASK, OP, PAD) \
+static void \
+name(Span *p) \
+{ \
+	uchar *d, *s, *m, *q, *cmap; \
+	int i, r, g, b, sa, x, ma, fd, bit, sdelta, mdelta; \
+	ulong t, t1; \
+\
+	d = p->d; \
+	s = p->s; \
+	m = p->m; \
+	bit = p->mbit; \
+	sdelta = p->sdelta; \
+	mdelta = p->mdelta; \
+	cmap = p->cmap; \
+	SET(q); SET(sa); SET(fd); SET(t1); \
+	for(i=0; i<p->dx; i++, d+=4, s+=sdelta){ \
+		SRC; \
+		MASK; \
+		OP \
+		PAD; \
+	} \
+	USED(r); USED(g); USED(b); USED(m); USED(q); USED(cmap); \
+	USED(sa); USED(x); USED(fd); USED(bit); USED(mdelta); USED(t1); \
+}
+
+SPANFN(xrgbS, SXRGB32, MOPAQUE, OPS, Pkeep)
+SPANFN(xrgbS1, SXRGB32, MGREY1, OPS, Pkeep)
+SPANFN(xrgbS8, SXRGB32, MGREY8, OPS, Pkeep)
+SPANFN(xrgbS8w, SXRGB32, MGREY8, OPSW, Pkeep)
+SPANFN(xrgbSc, SXRGB32, MOPAQUE, OPS, Pcopy)
+SPANFN(xrgbSz, SXRGB32, MOPAQUE, OPS, Pzero)
+SPANFN(xrgbover1c, SXRGB32, MGREY1, OPSOVERD, Pcopy)
+SPANFN(xrgbover1z, SXRGB32, MGREY1, OPSOVERD, Pzero)
+SPANFN(xrgbover8, SXRGB32, MGREY8, OPSOVERD, Pkeep)
+SPANFN(argbS, SARGB32, MOPAQUE, OPS, Pkeep)
+SPANFN(argbS1, SARGB32, MGREY1, OPS, Pkeep)
+SPANFN(argbS8, SARGB32, MGREY8, OPS, Pkeep)
+SPANFN(argbover, SARGB32, MOPAQUE, OPSOVERD, Pkeep)
+SPANFN(argbover1, SARGB32, MGREY1, OPSOVERD, Pkeep)
+SPANFN(argbover8, SARGB32, MGREY8, OPSOVERD, Pkeep)
+SPANFN(argbSw, SARGB32, MOPAQUE, OPSW, Pkeep)
+SPANFN(argbS1w, SARGB32, MGREY1, OPSW, Pkeep)
+SPANFN(argbS8w, SARGB32, MGREY8, OPSW, Pkeep)
+SPANFN(argboverw, SARGB32, MOPAQUE, OPSOVERDW, Pkeep)
+SPANFN(argbover1w, SARGB32, MGREY1, OPSOVERDW, Pkeep)
+SPANFN(argbover8w, SARGB32, MGREY8, OPSOVERDW, Pkeep)
+SPANFN(rgb24S, SRGB24, MOPAQUE, OPS, Pkeep)
+SPANFN(rgb24S1, SRGB24, MGREY1, OPS, Pkeep)
+SPANFN(rgb24S8, SRGB24, MGREY8, OPS, Pkeep)
+SPANFN(rgb24Sz, SRGB24, MOPAQUE, OPS, Pzero)
+SPANFN(rgb24over1z, SRGB24, MGREY1, OPSOVERD, Pzero)
+SPANFN(rgb24over8, SRGB24, MGREY8, OPSOVERD, Pkeep)
+SPANFN(k8S, SGREY8, MOPAQUE, OPS, Pkeep)
+SPANFN(k8S1, SGREY8, MGREY1, OPS, Pkeep)
+SPANFN(k8S8, SGREY8, MGREY8, OPS, Pkeep)
+SPANFN(k8Sz, SGREY8, MOPAQUE, OPS, Pzero)
+SPANFN(k8over1z, SGREY8, MGREY1, OPSOVERD, Pzero)
+SPANFN(k8over8, SGREY8, MGREY8, OPSOVERD, Pkeep)
+SPANFN(m8S, SCMAP8, MOPAQUE, OPS, Pkeep)
+SPANFN(m8S1, SCMAP8, MGREY1, OPS, Pkeep)
+SPANFN(m8S8, SCMAP8, MGREY8, OPS, Pkeep)
+SPANFN(m8Sz, SCMAP8, MOPAQUE, OPS, Pzero)
+SPANFN(m8over1z, SCMAP8, MGREY1, OPSOVERD, Pzero)
+SPANFN(m8over8, SCMAP8, MGREY8, OPSOVERD, Pkeep)
+
+/*
+ * SoverD through an opaque mask is S when the source has
+ * no alpha, so those share the S kernels but for the pad.
+ * fn is for a source that is not replicated, rfn for one
+ * that is.
+ */
+typedef struct Fastpath Fastpath;
+struct Fastpath
+{
+	ulong	dchan;
+	ulong	schan;
+	int	mask;
+	int	op;
+	Spanfn	*fn;
+	Spanfn	*rfn;
+	char	*name;
+};
+
+static Fastpath fastpaths[] = {
+	XRGB32, XRGB32, Mopaque, S, xrgbS, xrgbS, "xrgb32<xrgb32 S",
+	XRGB32, XRGB32, Mgrey1, S, xrgbS1, xrgbS1, "xrgb32<xrgb32 grey1 S",
+	XRGB32, XRGB32, Mgrey8, S, xrgbS8w, xrgbS8, "xrgb32<xrgb32 grey8 S",
+	XRGB32, XRGB32, Mopaque, SoverD, xrgbSc, xrgbSz, "xrgb32<xrgb32 SoverD",
+	XRGB32, XRGB32, Mgrey1, SoverD, xrgbover1c, xrgbover1z, "xrgb32<xrgb32 grey1 SoverD",
+	XRGB32, XRGB32, Mgrey8, SoverD, xrgbover8, xrgbover8, "xrgb32<xrgb32 grey8 SoverD",
+
+	XRGB32, ARGB32, Mopaque, S, argbSw, argbS, "xrgb32<argb32 S",
+	XRGB32, ARGB32, Mgrey1, S, argbS1w, argbS1, "xrgb32<argb32 grey1 S",
+	XRGB32, ARGB32, Mgrey8, S, argbS8w, argbS8, "xrgb32<argb32 grey8 S",
+	XRGB32, ARGB32, Mopaque, SoverD, argboverw, argbover, "xrgb32<argb32 SoverD",
+	XRGB32, ARGB32, Mgrey1, SoverD, argbover1w, argbover1, "xrgb32<argb32 grey1 SoverD",
+	XRGB32, ARGB32, Mgrey8, SoverD, argbover8w, argbover8, "xrgb32<argb32 grey8 SoverD",
+
+	XRGB32, RGB24, Mopaque, S, rgb24S, rgb24S, "xrgb32<rgb24 S",
+	XRGB32, RGB24, Mgrey1, S, rgb24S1, rgb24S1, "xrgb32<rgb24 grey1 S",
+	XRGB32, RGB24, Mgrey8, S, rgb24S8, rgb24S8, "xrgb32<rgb24 grey8 S",
+	XRGB32, RGB24, Mopaque, SoverD, rgb24Sz, rgb24Sz, "xrgb32<rgb24 SoverD",
+	XRGB32, RGB24, Mgrey1, SoverD, rgb24over1z, rgb24over1z, "xrgb32<rgb24 grey1 SoverD",
+	XRGB32, RGB24, Mgrey8, SoverD, rgb24over8, rgb24over8, "xrgb32<rgb24 grey8 SoverD",
+
+	XRGB32, GREY8, Mopaque, S, k8S, k8S, "xrgb32<grey8 S",
+	XRGB32, GREY8, Mgrey1, S, k8S1, k8S1, "xrgb32<grey8 grey1 S",
+	XRGB32, GREY8, Mgrey8, S, k8S8, k8S8, "xrgb32<grey8 grey8 S",
+	XRGB32, GREY8, Mopaque, SoverD, k8Sz, k8Sz, "xrgb32<grey8 SoverD",
+	XRGB32, GREY8, Mgrey1, SoverD, k8over1z, k8over1z, "xrgb32<grey8 grey1 SoverD",
+	XRGB32, GREY8, Mgrey8, SoverD, k8over8, k8over8, "xrgb32<grey8 grey8 SoverD",
+
+	XRGB32, CMAP8, Mopaque, S, m8S, m8S, "xrgb32<cmap8 S",
+	XRGB32, CMAP8, Mgrey1, S, m8S1, m8S1, "xrgb32<cmap8 grey1 S",
+	XRGB32, CMAP8, Mgrey8, S, m8S8, m8S8, "xrgb32<cmap8 grey8 S",
+	XRGB32, CMAP8, Mopaque, SoverD, m8Sz, m8Sz, "xrgb32<cmap8 SoverD",
+	XRGB32, CMAP8, Mgrey1, SoverD, m8over1z, m8over1z, "xrgb32<cmap8 grey1 SoverD",
+	XRGB32, CMAP8, Mgrey8, SoverD, m8over8, m8over8, "xrgb32<cmap8 grey8 SoverD",
+};
+
+/*
+ * Replicated images are fine as long as a span
+ * doesn't wrap around in x, or the image is one pixel wide.
+ */
+static int
+spanwraps(Memimage *img, Rectangle r)
+{
+	return (img->flags&Frepl) && Dx(img->r) > 1 && r.min.x+Dx(r) > img->r.max.x;
+}
+
+/*
+ * Find the kernel for par and leave it in par->fast for
+ * fastdraw, which may run once for each band.
+ */
+static char*
+fastpath(Memdrawparam *par)
+{
+	Fastpath *f;
+	int m;
+
+	par->fast = nil;
+	if(par->dst->chan != XRGB32 || (par->op != S && par->op != SoverD)
+	|| par->src->data == par->dst->data || par->mask->data == par->dst->data
+	|| spanwraps(par->src, par->sr))
+		return nil;
+	if(par->mask->chan == GREY1 && par->state&Fullmask)
+		m = Mopaque;
+	else if(spanwraps(par->mask, par->mr))
+		return nil;
+	else if(par->mask->chan == GREY1)
+		m = Mgrey1;
+	else if(par->mask->chan == GREY8)
+		m = Mgrey8;
+	else
+		return nil;
+	for(f=fastpaths; f<fastpaths+nelem(fastpaths); f++)
+		if(f->schan == par->src->chan && f->mask == m && f->op == par->op && f->dchan == par->dst->chan){
+			par->fast = f;
+			return f->name;
+		}
+	return nil;
+}
+
+static int
+replrow(Memimage *img, int y)
+{
+	if(img->flags&Frepl)
+		y = img->r.min.y + (y - img->r.min.y)%Dy(img->r);
+	return y;
+}
+
+static int
+fastdraw(Memdrawparam *par)
+{
+	int y, dy;
+	Fastpath *f;
+	Spanfn *fn;
+	Memimage *src, *mask, *dst;
+	Span sp;
+
+	f = par->fast;
+	src = par->src;
+	mask = par->mask;
+	dst = par->dst;
+	fn = src->flags&Frepl ? f->rfn : f->fn;
+	sp.dx = Dx(par->r);
+	sp.sdelta = (src->flags&Frepl) && Dx(src->r) == 1 ? 0 : src->depth/8;
+	sp.mdelta = (mask->flags&Frepl) && Dx(mask->r) == 1 ? 0 : 1;
+	sp.mbit = par->mr.min.x&7;
+	sp.cmap = src->chan == CMAP8 ? src->cmap->cmap2rgb : nil;
+	dy = Dy(par->r);
+	for(y=0; y<dy; y++){
+		sp.d = byteaddr(dst, Pt(par->r.min.x, par->r.min.y+y));
+		sp.s = byteaddr(src, Pt(par->sr.min.x, replrow(src, par->sr.min.y+y)));
+		sp.m = byteaddr(mask, Pt(par->mr.min.x, replrow(mask, par->mr.min.y+y)));
+		(*fn)(&sp);
+	}
+	return 1;
+}
 
 void
 memfillcolor(Memimage *i, ulong val)
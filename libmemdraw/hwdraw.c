@@ -3,10 +3,18 @@
 #include <draw.h>
 #include <memdraw.h>
 
+int	(*hwdrawhook)(Memdrawparam*);
+
+/*
+ * Called before each draw, and before each load and unload with
+ * the rectangle it touches as dst or src.  A screen driver that
+ * has gscreen drawn straight into video memory can set hwdrawhook,
+ * say to take a software cursor off the parts about to be used.
+ */
 int
 hwdraw(Memdrawparam *p)
 {
-	USED(p);
+	if(hwdrawhook != nil)
+		return hwdrawhook(p);
 	return 0;	/* could not satisfy request */
 }
-
@@ -244,12 +244,28 @@ verline(Memimage *dst, Point p0, Point p1, Memimage *src, Point dsrc, Rectangle
 }
 #endif /* NOTUSED */
 
+/*
+ * The last brush is kept for the next line end; each thread
+ * has its own, as several may be drawing at once.
+ */
+#if defined(__GNUC__)
+#define BRUSHTLS
+static __thread Memimage *brush;
+static __thread int brushradius;
+#endif
+
 static Memimage*
 membrush(int radius)
 {
-	static Memimage *brush;
-	static int brushradius;
+#ifndef BRUSHTLS
+	Memimage *brush;
 
+	brush = allocmemimage(Rect(0, 0, 2*radius+1, 2*radius+1), memopaque->chan);
+	if(brush != nil){
+		memfillcolor(brush, DTransparent);
+		memellipse(brush, Pt(radius, radius), radius, radius, -1, memopaque, Pt(radius, radius), S);
+	}
+#else
 	if(brush==nil || brushradius!=radius){
 		freememimage(brush);
 		brush = allocmemimage(Rect(0, 0, 2*radius+1, 2*radius+1), memopaque->chan);
@@ -259,9 +275,22 @@ membrush(int radius)
 		}
 		brushradius = radius;
 	}
+#endif
 	return brush;
 }
 
+/*
+ * Free the calling thread's brush.
+ */
+void
+_memfreebrush(void)
+{
+#ifdef BRUSHTLS
+	freememimage(brush);
+	brush = nil;
+#endif
+}
+
 static
 void
 discend(Point p, int radius, Memimage *dst, Memimage *src, Point dsrc, int op)
@@ -276,6 +305,9 @@ discend(Point p, int radius, Memimage *dst, Memimage *src, Point dsrc, int op)
 		r.max.x = p.x + radius+1;
 		r.max.y = p.y + radius+1;
 		memdraw(dst, r, src, addpt(r.min, dsrc), disc, Pt(0,0), op);
+#ifndef BRUSHTLS
+		freememimage(disc);
+#endif
 	}
 }
 
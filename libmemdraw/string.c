@@ -35,6 +35,43 @@ memimagestring(Memimage *b, Point p, Memimage *color, Point cp, Memsubfont *f, c
 	return p;
 }
 
+/*
+ * Draw a run of glyphs as though by
+ *	memdraw(dst, g->r, src, g->sp, mask, g->mp, op)
+ * for each, clipping to dst and any clear layers under it once
+ * for the whole run.  Obscured layers take the slow way.
+ */
+void
+memglyphs(Memimage *dst, Memimage *src, Memimage *mask, Memglyph *g, int n, int op)
+{
+	Memimage *i;
+	Memlayer *dl;
+	Rectangle clipr;
+	Point delta;
+
+	if(mask == nil)
+		mask = memopaque;
+
+	i = dst;
+	clipr = i->clipr;
+	if(!rectclip(&clipr, i->r))
+		return;
+	delta = ZP;
+	while((dl = i->layer) != nil && dl->clear && i != src){
+		delta = addpt(delta, dl->delta);
+		clipr = rectaddpt(clipr, dl->delta);
+		i = dl->screen->image;
+		if(!rectclip(&clipr, i->clipr) || !rectclip(&clipr, i->r))
+			return;
+	}
+	if(i->layer != nil || src->layer != nil || mask->layer != nil){
+		for(; n > 0; n--, g++)
+			memdraw(dst, g->r, src, g->sp, mask, g->mp, op);
+		return;
+	}
+	_memimageglyphs(i, clipr, delta, src, mask, g, n, op);
+}
+
 Point
 memsubfontwidth(Memsubfont *f, char *cs)
 {
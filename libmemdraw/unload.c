@@ -7,10 +7,17 @@ int
 unloadmemimage(Memimage *i, Rectangle r, uchar *data, int ndata)
 {
 	int y, l;
+	Memdrawparam par;
 	uchar *q;
 
 	if(badrect(r) || !rectinrect(r, i->r))
 		return -1;
+
+	memset(&par, 0, sizeof par);
+	par.src = i;
+	par.sr = r;
+	hwdraw(&par);
+
 	l = bytesperline(r, i->depth);
 	if(ndata < l*Dy(r))
 		return -1;
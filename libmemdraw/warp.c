@@ -713,15 +713,205 @@ correlate(Sampler *s, Point p)
 	return r<<24|g<<16|b<<8|a;
 }
 
+/*
+ * Span warping for 32-bit images with the colour bytes in B G R
+ * order followed by alpha or padding (XRGB32, ARGB32).  Each run of
+ * NW destination pixels whose samples all lie inside the source is
+ * done at once: the source words are gathered and the two even and
+ * the two odd bytes of every word are interpolated as 16-bit lanes,
+ * with the same fixed-point arithmetic as bilinear(), so the result
+ * is identical.  Runs that reach outside the source, and the last
+ * few pixels of a row, go through the sampler a pixel at a time.
+ */
+enum
+{
+	NW	= 8,
+};
+
+typedef struct Warprow Warprow;
+struct Warprow
+{
+	Sampler	*s;
+	Blitter	*b;
+	ulong	(*sample)(Sampler*, Point);
+	Point	sp0;
+	long	Δx, Δy;		/* step along a row */
+	int	smooth;
+	ulong	ones;		/* source bits that read as 1 */
+	ulong	keep;		/* destination bits left alone */
+};
+
+static int
+spanchan(ulong chan)
+{
+	return chan == XRGB32 || chan == ARGB32;
+}
+
+/* one pixel at a time, as memaffinewarp always did */
+static Point
+warppix(Warprow *w, Point dp, Point p2, int n)
+{
+	Sampler *s;
+	Point sp;
+	ulong c;
+
+	s = w->s;
+	for(; n > 0; n--, dp.x++){
+		s->Δx = fixfrac(p2.x);
+		s->Δy = fixfrac(p2.y);
+		sp.x = w->sp0.x + fix2int(p2.x);
+		sp.y = w->sp0.y + fix2int(p2.y);
+		c = w->sample(s, sp);
+		w->b->fn(w->b, dp, c);
+		p2.x += w->Δx;
+		p2.y += w->Δy;
+	}
+	return p2;
+}
+
+#if defined(__GNUC__) && !defined(NOSIMD) && (defined(__SSE2__) || defined(__ARM_NEON)) \
+	&& __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define SIMDWARP
+
+#if !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+typedef ulong	Wvec __attribute__((vector_size(4*NW)));
+typedef short	Wvec16 __attribute__((vector_size(4*NW)));
+
+#define WINLINE	static inline __attribute__((always_inline))
+#define WLERP(a, b, t)	((a) + ((((b) - (a))*(t))>>7))
+
+/* bilinear() on the byte lanes picked out by mask */
+WINLINE Wvec
+wlerp(Wvec c00, Wvec c01, Wvec c10, Wvec c11, Wvec16 tx, Wvec16 ty, ulong mask)
+{
+	Wvec16 a, b, c, d;
+
+	a = (Wvec16)(c00 & mask);
+	b = (Wvec16)(c01 & mask);
+	c = (Wvec16)(c10 & mask);
+	d = (Wvec16)(c11 & mask);
+	a = WLERP(a, b, tx);
+	c = WLERP(c, d, tx);
+	return (Wvec)WLERP(a, c, ty);
+}
+
+WINLINE void
+vwarprow(Warprow *w, Point dp, Point p2, int maxx)
+{
+	Sampler *s;
+	Rectangle sr;
+	uchar *sa, *p;
+	ulong *d, c;
+	uvlong c0, c1;
+	int o[NW];
+	Wvec c00, c01, c10, c11, v, t;
+	Wvec16 tx, ty;
+	Point q, sp;
+	int i, in, bpl, sm;
+
+	s = w->s;
+	sr = s->r;
+	sa = s->a;
+	bpl = s->bpl;
+	sm = w->smooth != 0;
+	while(maxx-dp.x >= NW){
+		in = 1;
+		q = p2;
+		for(i=0; i<NW; i++){
+			sp.x = w->sp0.x + fix2int(q.x);
+			sp.y = w->sp0.y + fix2int(q.y);
+			if(sp.x < sr.min.x || sp.x+sm >= sr.max.x
+			|| sp.y < sr.min.y || sp.y+sm >= sr.max.y){
+				in = 0;
+				break;
+			}
+			o[i] = sp.y*bpl + sp.x*4;
+			t[i] = fixfrac(q.x) * 0x10001;
+			v[i] = fixfrac(q.y) * 0x10001;
+			q.x += w->Δx;
+			q.y += w->Δy;
+		}
+		if(!in){
+			p2 = warppix(w, dp, p2, NW);
+			dp.x += NW;
+			continue;
+		}
+		if(sm){
+			for(i=0; i<NW; i++){
+				p = sa + o[i];
+				memmove(&c0, p, 8);
+				memmove(&c1, p+bpl, 8);
+				c00[i] = c0;
+				c01[i] = c0>>32;
+				c10[i] = c1;
+				c11[i] = c1>>32;
+			}
+			c00 |= w->ones;
+			c01 |= w->ones;
+			c10 |= w->ones;
+			c11 |= w->ones;
+			tx = (Wvec16)t;
+			ty = (Wvec16)v;
+			v = wlerp(c00, c01, c10, c11, tx, ty, 0x00FF00FF)
+			  | wlerp(c00>>8, c01>>8, c10>>8, c11>>8, tx, ty, 0x00FF00FF)<<8;
+		}else{
+			for(i=0; i<NW; i++){
+				memmove(&c, sa + o[i], 4);
+				v[i] = c;
+			}
+			v |= w->ones;
+		}
+		d = (ulong*)(w->b->a + dp.y*w->b->bpl + dp.x*4);
+		if(w->keep){
+			memmove(&t, d, sizeof t);
+			v = (v & ~w->keep) | (t & w->keep);
+		}
+		memmove(d, &v, sizeof v);
+		p2 = q;
+		dp.x += NW;
+	}
+	warppix(w, dp, p2, maxx-dp.x);
+}
+
+#define WARPFN(name, attr) \
+	static attr void name(Warprow *w, Point dp, Point p2, int maxx) \
+	{ vwarprow(w, dp, p2, maxx); }
+
+WARPFN(warprowvec, )
+
+#if defined(__x86_64__) || defined(__i386__)
+#define AVX2WARP
+WARPFN(warprowavx2, __attribute__((target("avx2"))))
+#endif
+
+static void (*warprow)(Warprow*, Point, Point, int);
+
+static void
+warpinit(void)
+{
+	warprow = warprowvec;
+#ifdef AVX2WARP
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2"))
+		warprow = warprowavx2;
+#endif
+}
+
+#endif /* SIMDWARP */
+
 int
 memaffinewarp(Memimage *d, Rectangle r, Memimage *s, Point sp0, Warp m, int smooth)
 {
 	ulong (*sample)(Sampler*, Point) = sample1;
+	Memdrawparam par;
 	Sampler samp;
 	Blitter blit;
-	Point sp, dp, p2, p2₀;
+	Warprow w;
+	Point dp, p2;
 	Rectangle dr;
-	ulong c;
 
 	dr = d->clipr;
 	rectclip(&dr, d->r);
@@ -732,35 +922,48 @@ memaffinewarp(Memimage *d, Rectangle r, Memimage *s, Point sp0, Warp m, int smoo
 	if(rectclip(&samp.r, s->r) == 0)
 		return 0;
 
+	memset(&par, 0, sizeof par);
+	par.dst = d;
+	par.r = r;
+	par.src = s;
+	par.sr = samp.r;
+	hwdraw(&par);
+
 	if(smooth)
 		sample = bilinear;
 
 	initsampler(&samp, s);
 	initblitter(&blit, d);
 
+	w.s = &samp;
+	w.b = &blit;
+	w.sample = sample;
+	w.sp0 = sp0;
+	w.Δx = m[0][0];
+	w.Δy = m[1][0];
+	w.smooth = smooth;
+	w.ones = s->chan == XRGB32 ? 0xFF000000 : 0;
+	w.keep = d->chan == XRGB32 ? 0xFF000000 : 0;
+
 	/*
 	 * incremental affine warping technique from:
 	 * 	“Fast Affine Transform for Real-Time Machine Vision Applications”,
 	 * 	Lee, S., Lee, GG., Jang, E.S., Kim, WY,
 	 * 	Intelligent Computing.  ICIC 2006. LNCS, vol 4113.
 	 */
-	p2 = p2₀ = xform((Point){int2fix(r.min.x - dr.min.x) + (1<<6), int2fix(r.min.y - dr.min.y) + (1<<6)}, m);
+	p2 = xform((Point){int2fix(r.min.x - dr.min.x) + (1<<6), int2fix(r.min.y - dr.min.y) + (1<<6)}, m);
 	for(dp.y = r.min.y; dp.y < r.max.y; dp.y++){
-	for(dp.x = r.min.x; dp.x < r.max.x; dp.x++){
-		samp.Δx = fixfrac(p2.x);
-		samp.Δy = fixfrac(p2.y);
-
-		sp.x = sp0.x + fix2int(p2.x);
-		sp.y = sp0.y + fix2int(p2.y);
-
-		c = sample(&samp, sp);
-		blit.fn(&blit, dp, c);
-
-		p2.x += m[0][0];
-		p2.y += m[1][0];
-	}
-		p2.x = p2₀.x += m[0][1];
-		p2.y = p2₀.y += m[1][1];
+		dp.x = r.min.x;
+#ifdef SIMDWARP
+		if(spanchan(s->chan) && spanchan(d->chan)){
+			if(warprow == nil)
+				warpinit();
+			warprow(&w, dp, p2, r.max.x);
+		}else
+#endif
+			warppix(&w, dp, p2, Dx(r));
+		p2.x += m[0][1];
+		p2.y += m[1][1];
 	}
 	return 0;
 }
@@ -806,9 +1009,285 @@ allocmemimagekernel(double *k, int dx, int dy, double denom)
 	return ik;
 }
 
+/*
+ * memimagecorrelate unpacks the source a row at a time into an int
+ * per channel and keeps the last Dy(k->r) rows in a ring.  If the
+ * kernel is the outer product of an integer row and column, as box
+ * and binomial blurs and edge detectors usually still are after
+ * rounding to fixed point, each source row is filtered with the row
+ * as it comes in and the filtered rows are summed down the column;
+ * otherwise all the taps are summed directly.  Either way the sums
+ * are exactly those correlate() forms, as long as they cannot
+ * overflow, so the result is the same; kernels for which they might,
+ * and images correlated onto themselves, still go through
+ * correlate().  Large images are done in bands with memdrawbands.
+ */
+#if defined(__GNUC__) && !defined(NOSIMD) && (defined(__SSE2__) || defined(__ARM_NEON))
+#define SIMDCORR
+
+typedef int	Cvec __attribute__((vector_size(4*4)));	/* r, g, b, a */
+
+typedef struct Corr Corr;
+struct Corr
+{
+	Sampler	*s;
+	Blitter	*b;
+	Rectangle	r;		/* destination */
+	Point	sp;		/* source for r.min, less the kernel center */
+	int	kdx, kdy;
+	long	*k;		/* kernel */
+	long	*kx, *ky;	/* its row and column, if separable */
+	int	n;		/* bands */
+	Cvec	**buf;		/* ring buffers, one per band */
+};
+
+static long
+gcd(long a, long b)
+{
+	long t;
+
+	while(b != 0){
+		t = a%b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+/*
+ * Factor k into kx⊗ky if it is an outer product of integers: the
+ * row is the first non-zero row over its gcd, which leaves each
+ * row an integer multiple of it.
+ */
+static int
+kernsep(long *k, int dx, int dy, long *kx, long *ky)
+{
+	int x, y, x0, y0;
+	long g;
+
+	x0 = -1;
+	for(y0 = 0; y0 < dy; y0++){
+		for(x0 = 0; x0 < dx; x0++)
+			if(k[y0*dx+x0] != 0)
+				break;
+		if(x0 < dx)
+			break;
+	}
+	if(y0 == dy)
+		return 0;
+	g = 0;
+	for(x = 0; x < dx; x++)
+		g = gcd(k[y0*dx+x] < 0 ? -k[y0*dx+x] : k[y0*dx+x], g);
+	for(x = 0; x < dx; x++)
+		kx[x] = k[y0*dx+x]/g;
+	for(y = 0; y < dy; y++){
+		if(k[y*dx+x0] % kx[x0] != 0)
+			return 0;
+		ky[y] = k[y*dx+x0] / kx[x0];
+		for(x = 0; x < dx; x++)
+			if(k[y*dx+x] != (vlong)ky[y]*kx[x])
+				return 0;
+	}
+	return 1;
+}
+
+#define CINLINE	static inline __attribute__((always_inline))
+
+CINLINE void
+unpackrow(Corr *c, Cvec *v, Point sp, int n)
+{
+	Sampler *s;
+	uchar *p;
+	ulong u;
+
+	s = c->s;
+	if((s->fn == getpixel_x8r8g8b8 || s->fn == getpixel_a8r8g8b8)
+	&& sp.y >= s->r.min.y && sp.y < s->r.max.y
+	&& sp.x >= s->r.min.x && sp.x+n <= s->r.max.x){
+		p = s->a + sp.y*s->bpl + sp.x*4;
+		for(; n > 0; n--, v++, p += 4)
+			*v = (Cvec){p[2], p[1], p[0], s->fn == getpixel_a8r8g8b8 ? p[3] : 0xFF};
+		return;
+	}
+	for(; n > 0; n--, v++, sp.x++){
+		u = sample1(c->s, sp);
+		*v = (Cvec){u>>24 & 0xFF, u>>16 & 0xFF, u>>8 & 0xFF, u & 0xFF};
+	}
+}
+
+CINLINE void
+vcorrband(void *a, int i)
+{
+	Corr *c;
+	Rectangle r;
+	Cvec *src, *h, *t, Σ, m, zero, max;
+	Point sp, dp;
+	uchar *d;
+	int j, x, w, sw, kdy, nrow;
+	long *kx;
+
+	c = a;
+	r = c->r;
+	r.min.y = c->r.min.y + i*Dy(c->r)/c->n;
+	r.max.y = c->r.min.y + (i+1)*Dy(c->r)/c->n;
+	w = Dx(r);
+	sw = w + c->kdx - 1;
+	kdy = c->kdy;
+	src = c->buf[i];
+	h = src + (c->ky != nil ? sw : 0);	/* separable: filtered rows */
+	zero = (Cvec){0, 0, 0, 0};
+	max = (Cvec){0xFF, 0xFF, 0xFF, 0xFF};
+
+	sp.x = c->sp.x;
+	sp.y = c->sp.y + r.min.y - c->r.min.y;
+	nrow = Dy(r) + kdy - 1;
+	for(j = 0; j < nrow; j++, sp.y++){
+		if(c->ky != nil){
+			unpackrow(c, src, sp, sw);
+			t = h + (j%kdy)*w;
+			for(x = 0; x < w; x++){
+				Σ = zero;
+				for(kx = c->kx; kx < c->kx+c->kdx; kx++)
+					Σ += src[x + (kx-c->kx)] * (int)*kx;
+				t[x] = Σ;
+			}
+		}else
+			unpackrow(c, src + (j%kdy)*sw, sp, sw);
+		if(j < kdy-1)
+			continue;
+
+		dp.y = r.min.y + j-(kdy-1);
+		d = nil;
+		if(c->b->fn == putpixel_x8r8g8b8 || c->b->fn == putpixel_a8r8g8b8)
+			d = c->b->a + dp.y*c->b->bpl + r.min.x*4;
+		for(x = 0; x < w; x++){
+			Σ = zero;
+			if(c->ky != nil){
+				int ty;
+
+				for(ty = 0; ty < kdy; ty++)
+					Σ += h[((j+1+ty)%kdy)*w + x] * (int)c->ky[ty];
+			}else{
+				int ty, tx;
+				long *k;
+
+				k = c->k;
+				for(ty = 0; ty < kdy; ty++){
+					t = src + ((j+1+ty)%kdy)*sw + x;
+					for(tx = 0; tx < c->kdx; tx++)
+						Σ += t[tx] * (int)*k++;
+				}
+			}
+			Σ >>= 7;
+			Σ &= ~(Σ < zero);
+			m = Σ > max;
+			Σ = (Σ & ~m) | (max & m);
+			if(d != nil){
+				d[0] = Σ[2];
+				d[1] = Σ[1];
+				d[2] = Σ[0];
+				if(c->b->fn == putpixel_a8r8g8b8)
+					d[3] = Σ[3];
+				d += 4;
+				continue;
+			}
+			dp.x = r.min.x + x;
+			c->b->fn(c->b, dp, (ulong)Σ[0]<<24 | Σ[1]<<16 | Σ[2]<<8 | Σ[3]);
+		}
+	}
+}
+
+#define CORRFN(name, attr) \
+	static attr void name(void *a, int i) \
+	{ vcorrband(a, i); }
+
+CORRFN(corrbandvec, )
+
+#if defined(__x86_64__) || defined(__i386__)
+#define AVX2CORR
+CORRFN(corrbandavx2, __attribute__((target("avx2"))))
+#endif
+
+static void (*corrband)(void*, int);
+
+static int
+fastcorrelate(Memimage *d, Rectangle r, Point sp, Sampler *samp, Blitter *blit, Memimage *k)
+{
+	Corr c;
+	long *kp, kx[64], ky[64];
+	vlong Σ;
+	int i, nk, nbuf, ok;
+
+	if(d->data == samp->i->data || !eqpt(k->r.min, ZP)
+	|| Dx(k->r) > nelem(kx) || Dy(k->r) > nelem(ky))
+		return 0;
+	kp = (long*)(k->data->bdata + k->zero);
+	nk = Dx(k->r)*Dy(k->r);
+	Σ = 0;
+	for(i = 0; i < nk; i++)
+		Σ += kp[i] < 0 ? -(vlong)kp[i] : kp[i];
+	if(Σ*0xFF > 0x7FFFFFFF)
+		return 0;
+
+	if(corrband == nil){
+		corrband = corrbandvec;
+#ifdef AVX2CORR
+		__builtin_cpu_init();
+		if(__builtin_cpu_supports("avx2"))
+			corrband = corrbandavx2;
+#endif
+	}
+
+	c.s = samp;
+	c.b = blit;
+	c.r = r;
+	c.sp = subpt(sp, samp->kcp);
+	c.kdx = Dx(k->r);
+	c.kdy = Dy(k->r);
+	c.k = kp;
+	c.kx = c.ky = nil;
+	if(kernsep(kp, c.kdx, c.kdy, kx, ky)){
+		c.kx = kx;
+		c.ky = ky;
+	}
+	c.n = 1;
+	if(memdrawbands != nil && memdrawbandpix > 0
+	&& Dx(r)*Dy(r) >= memdrawbandpix)
+		c.n = memdrawnband;
+	if(c.n > Dy(r))
+		c.n = Dy(r);
+	if(c.n < 1)
+		c.n = 1;
+
+	/* a source row, plus kdy rows of source or filtered pixels */
+	nbuf = Dx(r)+c.kdx-1 + c.kdy*(c.ky != nil ? Dx(r) : Dx(r)+c.kdx-1);
+	c.buf = malloc(c.n*sizeof(Cvec*));
+	ok = c.buf != nil;
+	if(ok){
+		memset(c.buf, 0, c.n*sizeof(Cvec*));
+		for(i = 0; i < c.n; i++)
+			if((c.buf[i] = malloc(nbuf*sizeof(Cvec))) == nil)
+				ok = 0;
+	}
+	if(ok){
+		if(c.n > 1)
+			memdrawbands(corrband, &c, c.n);
+		else
+			corrband(&c, 0);
+	}
+	if(c.buf != nil)
+		for(i = 0; i < c.n; i++)
+			free(c.buf[i]);
+	free(c.buf);
+	return ok;
+}
+
+#endif /* SIMDCORR */
+
 int
 memimagecorrelate(Memimage *d, Rectangle r, Memimage *s, Point sp0, Memimage *k)
 {
+	Memdrawparam par;
 	Sampler samp;
 	Blitter blit;
 	Point sp, dp;
@@ -824,6 +1303,13 @@ memimagecorrelate(Memimage *d, Rectangle r, Memimage *s, Point sp0, Memimage *k)
 	if(rectclip(&samp.r, s->r) == 0)
 		return 0;
 
+	memset(&par, 0, sizeof par);
+	par.dst = d;
+	par.r = r;
+	par.src = s;
+	par.sr = samp.r;
+	hwdraw(&par);
+
 	initsampler(&samp, s);
 	initblitter(&blit, d);
 
@@ -838,6 +1324,10 @@ memimagecorrelate(Memimage *d, Rectangle r, Memimage *s, Point sp0, Memimage *k)
 	samp.k = k;
 	samp.kcp = Pt(Dx(k->r)/2, Dy(k->r)/2);
 
+#ifdef SIMDCORR
+	if(fastcorrelate(d, r, Pt(sp0.x + r.min.x - dr.min.x, sp0.y + r.min.y - dr.min.y), &samp, &blit, k))
+		return 0;
+#endif
 	for(dp.y = r.min.y; dp.y < r.max.y; dp.y++)
 	for(dp.x = r.min.x; dp.x < r.max.x; dp.x++){
 		sp.x = sp0.x + dp.x - dr.min.x;
@@ -3,44 +3,260 @@
 #include <draw.h>
 #include <memdraw.h>
 
-#define	CHUNK	8000
-
-#define	HSHIFT	3	/* HSHIFT==5 runs slightly faster, but hash table is 64x bigger */
-#define	NHASH	(1<<(HSHIFT*NMATCH))
-#define	HMASK	(NHASH-1)
-#define	hupdate(h, c)	((((h)<<HSHIFT)^(c))&HMASK)
-typedef struct Hlist Hlist;
-struct Hlist{
-	uchar *s;
-	Hlist *next, *prev;
+/*
+ * The image is cut into strips of whole lines and each strip is
+ * compressed on its own into blocks of at most _compblocksize bytes.
+ * Blocks never refer back past their own start, so strips can be
+ * compressed in parallel with memdrawbands; there is just one strip
+ * if it is not set or the image is small.
+ *
+ * memwriteeffort trades speed for size: 0 writes the image
+ * uncompressed, 1 looks at one earlier string per byte, and each
+ * step up doubles that; from Lazyeffort on, a match is put off by
+ * a byte if a longer one starts there.
+ */
+int	memwriteeffort = 4;
+
+enum
+{
+	Maxeffort	= 9,
+	Lazyeffort	= 6,
+	HBITS		= 13,
+	NHASH		= 1<<HBITS,
+	HDR		= 2*12,		/* block header */
+};
+
+#define	hash3(p)	((((p)[0]<<16 | (p)[1]<<8 | (p)[2])*2654435761U) >> (32-HBITS))
+
+typedef struct Enc Enc;
+struct Enc
+{
+	uchar	*base;		/* start of block */
+	uchar	*end;		/* end of input */
+	uchar	*ins;		/* next position to hash */
+	int	chain;		/* strings to look at per match */
+	int	lazy;
+	int	head[NHASH];	/* latest position with each hash */
+	int	prev[NMEM];	/* earlier position with the same hash */
+};
+
+typedef struct Strip Strip;
+struct Strip
+{
+	Enc	*e;
+	uchar	*data;		/* first line */
+	int	bpl;
+	int	miny, maxy;
+	int	ncblock;
+	uchar	*out;		/* blocks, with headers */
+	int	nout;
+	int	err;
 };
 
+static void
+hashto(Enc *e, uchar *p)
+{
+	uchar *s;
+	int h, pos;
+
+	for(s = e->ins; s < p && s+NMATCH <= e->end; s++){
+		h = hash3(s);
+		pos = s - e->base;
+		e->prev[pos&(NMEM-1)] = e->head[h];
+		e->head[h] = pos;
+	}
+	e->ins = p;
+}
+
+/*
+ * Longest string before p matching at p, up to es.
+ */
+static int
+longest(Enc *e, uchar *p, uchar *es, uchar **qp)
+{
+	uchar *s, *t, *u;
+	int n, best, cand, k;
+
+	if(es-p < NMATCH)
+		return 0;
+	hashto(e, p);
+	best = NMATCH-1;
+	cand = e->head[hash3(p)];
+	for(k = e->chain; cand >= 0 && k > 0; k--, cand = e->prev[cand&(NMEM-1)]){
+		s = e->base + cand;
+		if(p-s > NMEM)
+			break;
+		if(s[best] != p[best])
+			continue;
+		for(t = p, u = s; t < es && *t == *u; t++, u++)
+			;
+		n = t-p;
+		if(n > best){
+			best = n;
+			*qp = s;
+			if(t == es)
+				break;
+		}
+	}
+	if(best < NMATCH)
+		return 0;
+	return best;
+}
+
+static uchar*
+dump(uchar *outp, uchar *eout, uchar *d, uchar *p)
+{
+	int n;
+
+	while(d < p){
+		n = p-d;
+		if(n > NDUMP)
+			n = NDUMP;
+		if(eout-outp < n+1)
+			return nil;
+		*outp++ = n-1+128;
+		memmove(outp, d, n);
+		outp += n;
+		d += n;
+	}
+	return outp;
+}
+
+/*
+ * Compress the lines from line on into at most ncblock bytes,
+ * stopping before the first one that does not fit.
+ * Returns the number of lines and sets *np to the size.
+ */
+static int
+compblock(Enc *e, uchar *line, int bpl, uchar *out, int ncblock, int *np)
+{
+	uchar *outp, *eout, *loutp, *eline, *p, *d, *es, *q, *q1;
+	int nline, run, run1, offs;
+
+	memset(e->head, 0xFF, sizeof e->head);
+	e->base = e->ins = line;
+	outp = loutp = out;
+	eout = out+ncblock;
+	for(nline = 0; line < e->end; nline++, line = eline){
+		eline = line+bpl;
+		d = line;
+		for(p = line; p < eline; ){
+			es = p+NRUN;
+			if(es > eline)
+				es = eline;
+			run = longest(e, p, es, &q);
+			if(run == 0){
+				p++;
+				continue;
+			}
+			if(e->lazy && run < es-p && p+1+NMATCH <= eline){
+				es = p+1+NRUN;
+				if(es > eline)
+					es = eline;
+				run1 = longest(e, p+1, es, &q1);
+				if(run1 > run){
+					p++;
+					continue;
+				}
+			}
+			if((outp = dump(outp, eout, d, p)) == nil || eout-outp < 2)
+				goto Bfull;
+			offs = p-q-1;
+			*outp++ = ((run-NMATCH)<<2) + (offs>>8);
+			*outp++ = offs&255;
+			p += run;
+			d = p;
+		}
+		if((outp = dump(outp, eout, d, p)) == nil)
+			goto Bfull;
+		loutp = outp;
+	}
+Bfull:
+	*np = loutp-out;
+	return nline;
+}
+
+static void
+compstrip(void *a, int i)
+{
+	Strip *s;
+	uchar *line, *out;
+	int y, n, nb;
+	char hdr[HDR+1];
+
+	s = (Strip*)a + i;
+	out = s->out;
+	line = s->data;
+	s->e->end = line + (s->maxy-s->miny)*s->bpl;
+	for(y = s->miny; y < s->maxy; y += n){
+		n = compblock(s->e, line, s->bpl, out+HDR, s->ncblock, &nb);
+		if(n == 0){
+			s->err = 1;
+			return;
+		}
+		sprint(hdr, "%11d %11d ", y+n, nb);
+		memmove(out, hdr, HDR);
+		out += HDR+nb;
+		line += n*s->bpl;
+	}
+	s->nout = out - s->out;
+}
+
+/*
+ * Compress r of i into at most n bytes of buf as one block
+ * for cloadmemimage.  Returns the size, or -1 if it won't fit.
+ */
+int
+cunloadmemimage(Memimage *i, Rectangle r, uchar *buf, int n)
+{
+	Enc *e;
+	uchar *data;
+	int bpl, nd, effort;
+
+	if(badrect(r) || !rectinrect(r, i->r))
+		return -1;
+	bpl = bytesperline(r, i->depth);
+	nd = Dy(r)*bpl;
+	data = malloc(nd);
+	e = malloc(sizeof(Enc));
+	if(data == nil || e == nil || unloadmemimage(i, r, data, nd) != nd){
+		n = -1;
+		goto Out;
+	}
+	effort = memwriteeffort;
+	if(effort > Maxeffort)
+		effort = Maxeffort;
+	if(effort < 1)
+		effort = 1;
+	e->chain = 1<<(effort-1);
+	e->lazy = effort >= Lazyeffort;
+	e->end = data+nd;
+	if(compblock(e, data, bpl, buf, n, &n) != Dy(r))
+		n = -1;
+Out:
+	free(data);
+	free(e);
+	return n;
+}
+
 int
 writememimage(int fd, Memimage *i)
 {
-	uchar *outbuf, *outp, *eout;		/* encoded data, pointer, end */
-	uchar *loutp;				/* start of encoded line */
-	Hlist *hash;				/* heads of hash chains of past strings */
-	Hlist *chain, *hp;			/* hash chain members, pointer */
-	Hlist *cp;				/* next Hlist to fall out of window */
-	int h;					/* hash value */
-	uchar *line, *eline;			/* input line, end pointer */
-	uchar *data, *edata;			/* input buffer, end pointer */
-	ulong n;				/* length of input buffer */
-	int bpl;				/* input line length */
-	int offs, runlen;			/* offset, length of consumed data */
-	uchar dumpbuf[NDUMP];			/* dump accumulator */
-	int ndump;				/* length of dump accumulator */
-	int ncblock;				/* size of compressed blocks */
+	uchar *data;
+	Strip *strip;
+	Enc *enc;
+	ulong n;
+	int bpl, ncblock, ns, dy, k, m, effort, ok;
 	Rectangle r;
-	uchar *p, *q, *s, *es, *t;
 	char hdr[11+5*12+1];
 	char cbuf[20];
 
 	r = i->r;
 	bpl = bytesperline(r, i->depth);
-	ncblock = _compblocksize(r, i->depth);
-	if(ncblock > CHUNK){
+	effort = memwriteeffort;
+	if(effort > Maxeffort)
+		effort = Maxeffort;
+	if(effort <= 0){
 		sprint(hdr, "%11s %11d %11d %11d %11d ",
 			chantostr(cbuf, i->chan), r.min.x, r.min.y, r.max.x, r.max.y);
 		if(write(fd, hdr, 5*12) != 5*12)
@@ -51,139 +267,64 @@ writememimage(int fd, Memimage *i)
 		return 0;
 	}
 
-	n = Dy(r)*bpl;
+	ncblock = _compblocksize(r, i->depth);
+	dy = Dy(r);
+	ns = 1;
+	if(memdrawbands != nil && memdrawbandpix > 0
+	&& Dx(r)*dy >= memdrawbandpix && dy >= 2)
+		ns = memdrawnband;
+	if(ns > dy)
+		ns = dy;
+	if(ns < 1)
+		ns = 1;
+
+	n = dy*bpl;
 	data = malloc(n);
-	if(data == 0){
-	ErrOut0:
-		free(data);
-		return -1;
-	}
+	strip = malloc(ns*sizeof(Strip));
+	enc = malloc(ns*sizeof(Enc));
+	ok = 0;
+	if(data == nil || strip == nil || enc == nil)
+		goto Out;
+	memset(strip, 0, ns*sizeof(Strip));
 	if(unloadmemimage(i, r, data, n) != n)
-		goto ErrOut0;
-	outbuf = malloc(ncblock);
-	hash = malloc(NHASH*sizeof(Hlist));
-	chain = malloc(NMEM*sizeof(Hlist));
-	if(outbuf == 0 || hash == 0 || chain == 0){
-	ErrOut:
-		free(outbuf);
-		free(hash);
-		free(chain);
-		goto ErrOut0;
+		goto Out;
+	for(k=0; k<ns; k++){
+		strip[k].e = &enc[k];
+		enc[k].chain = 1<<(effort-1);
+		enc[k].lazy = effort >= Lazyeffort;
+		strip[k].bpl = bpl;
+		strip[k].ncblock = ncblock;
+		strip[k].miny = r.min.y + k*dy/ns;
+		strip[k].maxy = r.min.y + (k+1)*dy/ns;
+		strip[k].data = data + (strip[k].miny-r.min.y)*bpl;
+		/* at worst every line gets a block of its own */
+		m = strip[k].maxy - strip[k].miny;
+		strip[k].out = malloc(m*(HDR+bpl+(bpl+NDUMP-1)/NDUMP) + HDR);
+		if(strip[k].out == nil)
+			goto Out;
 	}
+	if(ns > 1)
+		memdrawbands(compstrip, strip, ns);
+	else
+		compstrip(strip, 0);
+	for(k=0; k<ns; k++)
+		if(strip[k].err)
+			goto Out;
+
 	sprint(hdr, "compressed\n%11s %11d %11d %11d %11d ",
 		chantostr(cbuf, i->chan), r.min.x, r.min.y, r.max.x, r.max.y);
 	if(write(fd, hdr, 11+5*12) != 11+5*12)
-		goto ErrOut;
-	edata = data+n;
-	eout = outbuf+ncblock;
-	line = data;
-	r.max.y = r.min.y;
-	while(line != edata){
-		memset(hash, 0, NHASH*sizeof(Hlist));
-		memset(chain, 0, NMEM*sizeof(Hlist));
-		cp = chain;
-		h = 0;
-		outp = outbuf;
-		for(n = 0; n != NMATCH; n++)
-			h = hupdate(h, line[n]);
-		loutp = outbuf;
-		while(line != edata){
-			ndump = 0;
-			eline = line+bpl;
-			for(p = line; p != eline; ){
-				if(eline-p < NRUN)
-					es = eline;
-				else
-					es = p+NRUN;
-				q = 0;
-				runlen = 0;
-				for(hp = hash[h].next; hp; hp = hp->next){
-					s = p + runlen;
-					if(s >= es)
-						continue;
-					t = hp->s + runlen;
-					for(; s >= p; s--)
-						if(*s != *t--)
-							goto matchloop;
-					t += runlen+2;
-					s += runlen+2;
-					for(; s < es; s++)
-						if(*s != *t++)
-							break;
-					n = s-p;
-					if(n > runlen){
-						runlen = n;
-						q = hp->s;
-						if(n == NRUN)
-							break;
-					}
-			matchloop: ;
-				}
-				if(runlen < NMATCH){
-					if(ndump == NDUMP){
-						if(eout-outp < ndump+1)
-							goto Bfull;
-						*outp++ = ndump-1+128;
-						memmove(outp, dumpbuf, ndump);
-						outp += ndump;
-						ndump = 0;
-					}
-					dumpbuf[ndump++] = *p;
-					runlen = 1;
-				}
-				else{
-					if(ndump != 0){
-						if(eout-outp < ndump+1)
-							goto Bfull;
-						*outp++ = ndump-1+128;
-						memmove(outp, dumpbuf, ndump);
-						outp += ndump;
-						ndump = 0;
-					}
-					offs = p-q-1;
-					if(eout-outp < 2)
-						goto Bfull;
-					*outp++ = ((runlen-NMATCH)<<2) + (offs>>8);
-					*outp++ = offs&255;
-				}
-				for(q = p+runlen; p != q; p++){
-					if(cp->prev)
-						cp->prev->next = 0;
-					cp->next = hash[h].next;
-					cp->prev = &hash[h];
-					if(cp->next)
-						cp->next->prev = cp;
-					cp->prev->next = cp;
-					cp->s = p;
-					if(++cp == &chain[NMEM])
-						cp = chain;
-					if(edata-p > NMATCH)
-						h = hupdate(h, p[NMATCH]);
-				}
-			}
-			if(ndump != 0){
-				if(eout-outp < ndump+1)
-					goto Bfull;
-				*outp++ = ndump-1+128;
-				memmove(outp, dumpbuf, ndump);
-				outp += ndump;
-			}
-			line = eline;
-			loutp = outp;
-			r.max.y++;
-		}
-	Bfull:
-		if(loutp == outbuf)
-			goto ErrOut;
-		n = loutp-outbuf;
-		sprint(hdr, "%11d %11ld ", r.max.y, n);
-		write(fd, hdr, 2*12);
-		write(fd, outbuf, n);
-		r.min.y = r.max.y;
-	}
+		goto Out;
+	for(k=0; k<ns; k++)
+		if(write(fd, strip[k].out, strip[k].nout) != strip[k].nout)
+			goto Out;
+	ok = 1;
+Out:
+	if(strip != nil)
+		for(k=0; k<ns; k++)
+			free(strip[k].out);
+	free(strip);
+	free(enc);
 	free(data);
-	free(outbuf);
-	free(hash);
-	free(chain);
-	return 0;
+	return ok ? 0 : -1;
 }
@@ -24,19 +24,19 @@ ldrawop(Memimage *dst, Rectangle screenr, Rectangle clipr, void *etc, int insave
 	int ok;
 
 	d = etc;
-	if(insave && d->dstlayer->save==nil)
-		return;
-
 	p0 = addpt(screenr.min, d->deltas);
 	p1 = addpt(screenr.min, d->deltam);
 
 	if(insave){
-		r = rectsubpt(screenr, d->dstlayer->delta);
-		clipr = rectsubpt(clipr, d->dstlayer->delta);
+		/* save area tiles are relative to the layer's corner */
+		r = rectsubpt(screenr, d->dstlayer->screenr.min);
+		clipr = rectsubpt(clipr, d->dstlayer->screenr.min);
+		if(dst == nil && (dst = _memltile(d->dstlayer, r.min, 1)) == nil)
+			return;
 	}else
 		r = screenr;
 
-	/* now in logical coordinates */
+	/* now in dst's coordinates */
 
 	/* clipr may have narrowed what we should draw on, so clip if necessary */
 	if(!rectinrect(r, clipr)){
@@ -54,7 +54,8 @@ void
 memdraw(Memimage *dst, Rectangle r, Memimage *src, Point p0, Memimage *mask, Point p1, int op)
 {
 	struct Draw d;
-	Rectangle srcr, tr, mr;
+	Rectangle srcr, mr;
+	Memimage *tmp;
 	Memlayer *dl, *sl;
 
 	if(mask == nil)
@@ -109,33 +110,14 @@ memdraw(Memimage *dst, Rectangle r, Memimage *src, Point p0, Memimage *mask, Poi
 	 */
 
 	/*
-	 * if dst and src are the same layer, just draw in save area and expose.
+	 * if dst and src are the same layer, copy the source out first.
 	 */
 	if(dl!=nil && dst==src){
-		if(dl->save == nil)
+		tmp = _memlread(src, rectsubpt(srcr, dl->delta));
+		if(tmp == nil)
 			return;	/* refresh function makes this case unworkable */
-		if(rectXrect(r, srcr)){
-			tr = r;
-			if(srcr.min.x < tr.min.x){
-				p1.x += tr.min.x - srcr.min.x;
-				tr.min.x = srcr.min.x;
-			}
-			if(srcr.min.y < tr.min.y){
-				p1.y += tr.min.y - srcr.min.y;
-				tr.min.y = srcr.min.y;
-			}
-			if(srcr.max.x > tr.max.x)
-				tr.max.x = srcr.max.x;
-			if(srcr.max.y > tr.max.y)
-				tr.max.y = srcr.max.y;
-			memlhide(dst, tr);
-		}else{
-			memlhide(dst, r);
-			memlhide(dst, srcr);
-		}
-		memdraw(dl->save, rectsubpt(r, dl->delta), dl->save,
-			subpt(srcr.min, src->layer->delta), mask, p1, op);
-		memlexpose(dst, r);
+		memdraw(dst, rectsubpt(r, dl->delta), tmp, subpt(p0, dl->delta), mask, p1, op);
+		freememimage(tmp);
 		return;
 	}
 
@@ -150,18 +132,15 @@ memdraw(Memimage *dst, Rectangle r, Memimage *src, Point p0, Memimage *mask, Poi
 			}
 			goto Top;
 		}
-		/* relatively rare case; use save area */
-		if(sl->save == nil)
+		/* relatively rare case; copy the source out */
+		tmp = _memlread(src, rectsubpt(srcr, sl->delta));
+		if(tmp == nil)
 			return;	/* refresh function makes this case unworkable */
-		memlhide(src, srcr);
-		/* convert back to logical coordinates */
-		p0.x -= sl->delta.x;
-		p0.y -= sl->delta.y;
-		srcr.min.x -= sl->delta.x;
-		srcr.min.y -= sl->delta.y;
-		srcr.max.x -= sl->delta.x;
-		srcr.max.y -= sl->delta.y;
-		src = src->layer->save;
+		if(dl != nil)
+			r = rectsubpt(r, dl->delta);
+		memdraw(dst, r, tmp, subpt(p0, sl->delta), mask, p1, op);
+		freememimage(tmp);
+		return;
 	}
 
 	/*
@@ -9,15 +9,6 @@ memlalloc(Memscreen *s, Rectangle screenr, Refreshfn refreshfn, void *refreshptr
 {
 	Memlayer *l;
 	Memimage *n;
-	static Memimage *paint;
-
-	if(paint == nil){
-		paint = allocmemimage(Rect(0,0,1,1), RGBA32);
-		if(paint == nil)
-			return nil;
-		paint->flags |= Frepl;
-		paint->clipr = Rect(-0x3FFFFFF, -0x3FFFFFF, 0x3FFFFFF, 0x3FFFFFF);
-	}
 
 	n = allocmemimaged(screenr, s->image->chan, s->image->data);
 	if(n == nil)
@@ -29,23 +20,21 @@ memlalloc(Memscreen *s, Rectangle screenr, Refreshfn refreshfn, void *refreshptr
 	}
 
 	l->screen = s;
-	if(refreshfn)
-		l->save = nil;
-	else{
-		l->save = allocmemimage(screenr, s->image->chan);
-		if(l->save == nil){
-			free(l);
-			free(n);
-			return nil;
-		}
-		/* allocmemimage doesn't initialize memory; this paints save area */
-		if(val != DNofill)
-			memfillcolor(l->save, val);
-	}
+	/* the save area is made a tile at a time as it is drawn on */
+	l->saved = refreshfn == nil;
+	l->tile = nil;
+	l->ntile = 0;
+	l->saveval = val;
 	l->refreshfn = refreshfn;
 	l->refreshptr = nil;	/* don't set it until we're done */
 	l->screenr = screenr;
 	l->delta = Pt(0,0);
+	memset(&l->vis, 0, sizeof l->vis);
+	memset(&l->obs, 0, sizeof l->obs);
+	memset(&l->tvis, 0, sizeof l->tvis);
+	memset(&l->texp, 0, sizeof l->texp);
+	l->visok = 0;
+	l->obsok = 0;
 
 	n->data->ref++;
 	n->zero = s->image->zero;
@@ -70,10 +59,6 @@ memlalloc(Memscreen *s, Rectangle screenr, Refreshfn refreshfn, void *refreshptr
 	 * paint with requested color; previously exposed areas are already right
 	 * if this window has backing store, but just painting the whole thing is simplest.
 	 */
-	if(val != DNofill){
-		memsetchan(paint, n->chan);
-		memfillcolor(paint, val);
-		memdraw(n, n->r, paint, n->r.min, nil, n->r.min, S);
-	}
+	_memlfill(n, n->r, val);
 	return n;
 }
@@ -47,7 +47,45 @@ _layerop(
 		r.min.x = fr.min.x;
 	}
 	/* r is covered by front, so put in save area */
-	(*fn)(i->layer->save, r, clipr, etc, 1);
+	_memlsaveop(fn, i->layer, r, clipr, etc);
+}
+
+/*
+ * Call fn for the rectangles of g that meet r, on the screen
+ * or in l's save area; they are sorted by min.y, so start at
+ * the first band that reaches below r.min.y.
+ */
+static void
+regionop(
+	void (*fn)(Memimage*, Rectangle, Rectangle, void*, int),
+	Memlayer *l,
+	Memregion *g,
+	Rectangle r,
+	Rectangle clipr,
+	void *etc,
+	int insave)
+{
+	Rectangle x;
+	int lo, hi, m;
+
+	lo = 0;
+	hi = g->nr;
+	while(lo < hi){
+		m = (lo+hi)/2;
+		if(g->r[m].max.y <= r.min.y)
+			lo = m+1;
+		else
+			hi = m;
+	}
+	for(; lo<g->nr && g->r[lo].min.y<r.max.y; lo++){
+		x = r;
+		if(!rectclip(&x, g->r[lo]))
+			continue;
+		if(insave)
+			_memlsaveop(fn, l, x, clipr, etc);
+		else
+			fn(l->screen->image, x, clipr, etc, 0);
+	}
 }
 
 /*
@@ -71,6 +109,15 @@ _memlayerop(
 		fn(l->screen->image, screenr, clipr, etc, 0);
 		return;
 	}
+	if(_memlvisible(i) == 0){
+		regionop(fn, l, &l->vis, screenr, clipr, etc, 0);
+		regionop(fn, l, &l->obs, screenr, clipr, etc, 1);
+		return;
+	}
+
+	/*
+	 * No memory for the regions; split against the windows in front.
+	 */
 	r = screenr;
 	scr = l->screen->image->clipr;
 
@@ -87,26 +134,26 @@ _memlayerop(
 	*/
 	if(!rectXrect(r, scr)){
 		/* completely offscreen; easy */
-		fn(l->save, r, clipr, etc, 1);
+		_memlsaveop(fn, l, r, clipr, etc);
 		return;
 	}
 	if(r.min.y < scr.min.y){
 		/* above screen */
-		fn(l->save, Rect(r.min.x, r.min.y, r.max.x, scr.min.y), clipr, etc, 1);
+		_memlsaveop(fn, l, Rect(r.min.x, r.min.y, r.max.x, scr.min.y), clipr, etc);
 		r.min.y = scr.min.y;
 	}
 	if(r.max.y > scr.max.y){
 		/* below screen */
-		fn(l->save, Rect(r.min.x, scr.max.y, r.max.x, r.max.y), clipr, etc, 1);
+		_memlsaveop(fn, l, Rect(r.min.x, scr.max.y, r.max.x, r.max.y), clipr, etc);
 		r.max.y = scr.max.y;
 	}
 	if(r.min.x < scr.min.x){
 		/* left of screen */
-		fn(l->save, Rect(r.min.x, r.min.y, scr.min.x, r.max.y), clipr, etc, 1);
+		_memlsaveop(fn, l, Rect(r.min.x, r.min.y, scr.min.x, r.max.y), clipr, etc);
 		r.min.x = scr.min.x;
 	}
 	if(r.max.x > scr.max.x){
 		/* right of screen */
-		fn(l->save, Rect(scr.max.x, r.min.y, r.max.x, r.max.y), clipr, etc, 1);
+		_memlsaveop(fn, l, Rect(scr.max.x, r.min.y, r.max.x, r.max.y), clipr, etc);
 	}
 }
@@ -12,8 +12,8 @@ memldelete(Memimage *i)
 
 	l = i->layer;
 	/* free backing store and disconnect refresh, to make pushback fast */
-	freememimage(l->save);
-	l->save = nil;
+	_memlfreesave(l);
+	l->saved = 0;
 	l->refreshptr = nil;
 	memltorear(i);
 
@@ -30,6 +30,7 @@ memldelete(Memimage *i)
 		s->frontmost = nil;
 		s->rearmost = nil;
 	}
+	_memlfreevis(l);
 	free(l);
 	freememimage(i);
 }
@@ -43,7 +44,8 @@ memlfree(Memimage *i)
 	Memlayer *l;
 
 	l = i->layer;
-	freememimage(l->save);
+	_memlfreesave(l);
+	_memlfreevis(l);
 	free(l);
 	freememimage(i);
 }
@@ -54,6 +56,8 @@ _memlsetclear(Memscreen *s)
 	Memimage *i, *j;
 	Memlayer *l;
 
+	if(s->trans)
+		return;	/* memlcommit will */
 	for(i=s->rearmost; i; i=i->layer->front){
 		l = i->layer;
 		l->clear = rectinrect(l->screenr, l->screen->image->clipr);
@@ -64,4 +68,5 @@ _memlsetclear(Memscreen *s)
 					break;
 				}
 	}
+	_memltrimsave(s);
 }
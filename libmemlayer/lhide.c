@@ -16,7 +16,7 @@
 
 static
 void
-lhideop(Memimage *src, Rectangle screenr, Rectangle clipr, void *etc, int insave)
+lhidetile(Memimage *dst, Rectangle screenr, Rectangle clipr, void *etc, int insave)
 {
 	Rectangle r;
 	Memlayer *l;
@@ -24,16 +24,26 @@ lhideop(Memimage *src, Rectangle screenr, Rectangle clipr, void *etc, int insave
 	USED(clipr.min.x);
 	USED(insave);
 	l = etc;
-	if(src != l->save){	/* do nothing if src is already in save area */
-		r = rectsubpt(screenr, l->delta);
-		memdraw(l->save, r, src, screenr.min, nil, screenr.min, S);
-	}
+	r = rectsubpt(screenr, l->screenr.min);
+	if(dst == nil && (dst = _memltile(l, r.min, 1)) == nil)
+		return;
+	memdraw(dst, r, l->screen->image, screenr.min, nil, screenr.min, S);
+}
+
+static
+void
+lhideop(Memimage *src, Rectangle screenr, Rectangle clipr, void *etc, int insave)
+{
+	USED(src);
+	USED(clipr.min.x);
+	if(!insave)	/* do nothing if src is already in save area */
+		_memlsaveop(lhidetile, etc, screenr, screenr, etc);
 }
 
 void
 memlhide(Memimage *i, Rectangle screenr)
 {
-	if(i->layer->save == nil)
+	if(!i->layer->saved)
 		return;
 	if(rectclip(&screenr, i->layer->screen->image->r) == 0)
 		return;
@@ -42,20 +52,35 @@ memlhide(Memimage *i, Rectangle screenr)
 
 static
 void
-lexposeop(Memimage *dst, Rectangle screenr, Rectangle clipr, void *etc, int insave)
+lexposetile(Memimage *src, Rectangle screenr, Rectangle clipr, void *etc, int insave)
 {
 	Memlayer *l;
 	Rectangle r;
 
+	USED(clipr.min.x);
+	USED(insave);
+	l = etc;
+	r = rectsubpt(screenr, l->screenr.min);
+	if(src == nil)
+		_memlfill(l->screen->image, screenr, l->saveval);
+	else
+		memdraw(l->screen->image, screenr, src, r.min, nil, r.min, S);
+}
+
+static
+void
+lexposeop(Memimage *dst, Rectangle screenr, Rectangle clipr, void *etc, int insave)
+{
+	Memlayer *l;
+
 	USED(clipr.min.x);
 	if(insave)	/* if dst is save area, don't bother */
 		return;
 	l = etc;
-	r = rectsubpt(screenr, l->delta);
-	if(l->save)
-		memdraw(dst, screenr, l->save, r.min, nil, r.min, S);
+	if(l->saved)
+		_memlsaveop(lexposetile, l, screenr, screenr, l);
 	else
-		l->refreshfn(dst, r, l->refreshptr);
+		l->refreshfn(dst, rectsubpt(screenr, l->delta), l->refreshptr);
 }
 
 void
@@ -8,7 +8,6 @@ struct Lline
 {
 	Point			p0;
 	Point			p1;
-	Point			delta;
 	int			end0;
 	int			end1;
 	int			radius;
@@ -81,7 +80,6 @@ _memline(Memimage *dst, Point p0, Point p1, int end0, int end1, int radius, Memi
 	ll.dstlayer = dst->layer;
 	ll.src = src;
 	ll.radius = radius;
-	ll.delta = dl->delta;
 	ll.op = op;
 	_memlayerop(llineop, dst, r, r, &ll);
 }
@@ -91,18 +89,20 @@ void
 llineop(Memimage *dst, Rectangle screenr, Rectangle clipr, void *etc, int insave)
 {
 	struct Lline *ll;
-	Point p0, p1;
+	Point p0, p1, o;
 
 	USED(screenr.min.x);
 	ll = etc;
-	if(insave && ll->dstlayer->save==nil)
-		return;
 	if(!rectclip(&clipr, screenr))
 		return;
 	if(insave){
-		p0 = subpt(ll->p0, ll->delta);
-		p1 = subpt(ll->p1, ll->delta);
-		clipr = rectsubpt(clipr, ll->delta);
+		/* save area tiles are relative to the layer's corner */
+		o = ll->dstlayer->screenr.min;
+		p0 = subpt(ll->p0, o);
+		p1 = subpt(ll->p1, o);
+		clipr = rectsubpt(clipr, o);
+		if(dst == nil && (dst = _memltile(ll->dstlayer, clipr.min, 1)) == nil)
+			return;
 	}else{
 		p0 = ll->p0;
 		p1 = ll->p1;
@@ -4,13 +4,84 @@
 #include <memdraw.h>
 #include <memlayer.h>
 
+struct Load
+{
+	Memlayer	*l;
+	Rectangle	r;	/* being loaded, on the screen */
+	uchar		*data;
+	int		bpl;
+	int		n;	/* pieces seen */
+	Memimage	*i;	/* the last one */
+	Rectangle	ir;
+	int		insave;
+};
+
+/*
+ * Return the image holding screenr of l, i or a save area tile
+ * made if need be, and set *d to what to subtract from screenr
+ * to get its coordinates there.
+ */
+static Memimage*
+where(Memlayer *l, Memimage *i, Rectangle screenr, int insave, Point *d)
+{
+	*d = ZP;
+	if(!insave)
+		return i;
+	/* save area tiles are relative to the layer's corner */
+	*d = l->screenr.min;
+	if(i == nil)
+		i = _memltile(l, subpt(screenr.min, *d), 1);
+	return i;
+}
+
+/*
+ * Load the part of the data in screenr, which is uncompressed,
+ * straight into where it is kept.
+ */
+static void
+loadop(Memimage *i, Rectangle screenr, Rectangle clipr, void *etc, int insave)
+{
+	struct Load *ld;
+	Point d;
+	uchar *p;
+	int y;
+
+	USED(clipr.min.x);
+	ld = etc;
+	if((i = where(ld->l, i, screenr, insave, &d)) == nil)
+		return;
+	p = ld->data + (screenr.min.y-ld->r.min.y)*ld->bpl
+		+ (screenr.min.x*i->depth>>3) - (ld->r.min.x*i->depth>>3);
+	if(screenr.min.x == ld->r.min.x && screenr.max.x == ld->r.max.x){
+		loadmemimage(i, rectsubpt(screenr, d), p, ld->bpl*Dy(screenr));
+		return;
+	}
+	for(y=screenr.min.y; y<screenr.max.y; y++, p+=ld->bpl)
+		loadmemimage(i, rectsubpt(Rect(screenr.min.x, y, screenr.max.x, y+1), d), p, ld->bpl);
+}
+
+static void
+pieceop(Memimage *i, Rectangle screenr, Rectangle clipr, void *etc, int insave)
+{
+	struct Load *ld;
+
+	USED(clipr.min.x);
+	ld = etc;
+	ld->n++;
+	ld->i = i;
+	ld->ir = screenr;
+	ld->insave = insave;
+}
+
 int
 memload(Memimage *dst, Rectangle r, uchar *data, int n, int iscompressed)
 {
 	int (*loadfn)(Memimage*, Rectangle, uchar*, int);
-	Memimage *tmp;
+	struct Load ld;
+	Memimage *tmp, *i;
 	Memlayer *dl;
 	Rectangle lr;
+	Point d;
 	int dx;
 
 	loadfn = loadmemimage;
@@ -37,14 +108,38 @@ memload(Memimage *dst, Rectangle r, uchar *data, int n, int iscompressed)
 	}
 
 	/*
-	 * dst is an obscured layer or data is unaligned
+	 * dst is an obscured layer.  If the data's bytes line up with
+	 * both the screen and the save area, load it straight into the
+	 * visible parts and the save area tiles.  A compressed image's
+	 * back references reach anywhere in what has been decoded, so
+	 * it can only be decoded in place if it all falls in one piece,
+	 * and cloadmemimage writes whole bytes, so only if its edges
+	 * are on byte boundaries.
 	 */
-	if(dl->save && dx==0){
-		n = loadfn(dl->save, lr, data, n);
-		if(n > 0)
-			memlexpose(dst, r);
-		return n;
+	memset(&ld, 0, sizeof ld);
+	ld.l = dl;
+	ld.r = r;
+	ld.data = data;
+	ld.bpl = bytesperline(lr, dst->depth);
+	if(dx==0 && (dl->screenr.min.x&(7/dst->depth))==0){
+		if(!iscompressed){
+			if(n < ld.bpl*Dy(lr))
+				return -1;
+			_memlayerop(loadop, dst, r, r, &ld);
+			return ld.bpl*Dy(lr);
+		}
+		if((r.min.x|r.max.x)&(7/dst->depth))
+			goto Copy;
+		_memlayerop(pieceop, dst, r, r, &ld);
+		if(ld.n == 1 && eqrect(ld.ir, r)
+		&& (i = where(dl, ld.i, r, ld.insave, &d)) != nil)
+			return cloadmemimage(i, rectsubpt(r, d), data, n);
 	}
+
+	/*
+	 * Otherwise decode into a copy and draw that.
+	 */
+    Copy:
 	tmp = allocmemimage(lr, dst->chan);
 	if(tmp == nil)
 		return -1;
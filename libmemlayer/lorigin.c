@@ -12,7 +12,7 @@ memlorigin(Memimage *i, Point log, Point scr)
 {
 	Memlayer *l;
 	Memscreen *s;
-	Memimage *t, *shad, *nsave;
+	Memimage *t, *shad;
 	Rectangle x, newr, oldr;
 	Point delta;
 	int overlap, eqlog, eqscr, wasclear;
@@ -25,30 +25,25 @@ memlorigin(Memimage *i, Point log, Point scr)
 	eqlog = eqpt(log, i->r.min);
 	if(eqscr && eqlog)
 		return 0;
-	nsave = nil;
-	if(eqlog==0 && l->save!=nil){
-		nsave = allocmemimage(Rect(log.x, log.y, log.x+Dx(oldr), log.y+Dy(oldr)), i->chan);
-		if(nsave == nil)
-			return -1;
-	}
 
 	/*
 	 * Bring it to front and move logical coordinate system.
+	 * The save area is relative to screenr, so it stays put.
 	 */
 	memltofront(i);
 	wasclear = l->clear;
-	if(nsave){
-		if(!wasclear)
-			memimagedraw(nsave, nsave->r, l->save, l->save->r.min, nil, Pt(0,0), S);
-		freememimage(l->save);
-		l->save = nsave;
-	}
 	delta = subpt(log, i->r.min);
 	i->r = rectaddpt(i->r, delta);
 	i->clipr = rectaddpt(i->clipr, delta);
 	l->delta = subpt(l->screenr.min, i->r.min);
 	if(eqscr)
 		return 0;
+	if(s->trans){
+		/* memlcommit moves the contents */
+		l->screenr = newr;
+		l->delta = subpt(scr, i->r.min);
+		return 1;
+	}
 
 	/*
 	 * To clean up old position, make a shadow window there, don't paint it,
@@ -69,6 +64,8 @@ memlorigin(Memimage *i, Point log, Point scr)
 	l->rear = shad;
 	l->front = nil;
 	shad->layer->clear = 0;
+	_memlinvalvis(i);
+	_memlinvalvis(shad);
 
 	/*
 	 * Shadow is now holding down the fort at the old position.
@@ -80,6 +77,7 @@ memlorigin(Memimage *i, Point log, Point scr)
 		if(overlap){
 			memlhide(t, x);
 			t->layer->clear = 0;
+			_memlinvalvis(t);
 		}
 	}
 	l->screenr = newr;
@@ -0,0 +1,277 @@
+#include <u.h>
+#include <libc.h>
+#include <draw.h>
+#include <memdraw.h>
+#include <memlayer.h>
+
+/*
+ * A layer's save area is a grid of Tile-pixel squares, each
+ * made the first time something is drawn on it.  Parts of the
+ * layer that are not on the screen and have no tile are the
+ * colour saveval.  After each shuffle, tiles that are entirely
+ * on the screen again are freed, and if memlzsave is set, tiles
+ * that have not been used for a while are compressed; they are
+ * expanded when next used.
+ *
+ * Tile coordinates are relative to the layer's screenr.min, so
+ * neither moving the layer nor changing its logical origin
+ * touches the save area.
+ */
+enum
+{
+	Tile	= 128,
+};
+
+int	memlzsave = 64;
+
+static ulong	saveclock;
+
+/*
+ * Paint r of dst with val.
+ */
+void
+_memlfill(Memimage *dst, Rectangle r, ulong val)
+{
+	static Memimage *paint;
+
+	if(val == DNofill)
+		return;
+	if(paint == nil){
+		paint = allocmemimage(Rect(0,0,1,1), RGBA32);
+		if(paint == nil)
+			return;
+		paint->flags |= Frepl;
+		paint->clipr = Rect(-0x3FFFFFF, -0x3FFFFFF, 0x3FFFFFF, 0x3FFFFFF);
+	}
+	memsetchan(paint, dst->chan);
+	memfillcolor(paint, val);
+	memdraw(dst, r, paint, r.min, nil, r.min, S);
+}
+
+static Rectangle
+tilerect(Memlayer *l, int x, int y)
+{
+	Rectangle r;
+
+	r = Rect(x*Tile, y*Tile, (x+1)*Tile, (y+1)*Tile);
+	rectclip(&r, Rect(0, 0, Dx(l->screenr), Dy(l->screenr)));
+	return r;
+}
+
+/*
+ * Return the tile of l's save area holding p, expanding it if
+ * it is compressed and, if alloc is set, making it if it is not
+ * there yet.  Nil if there is no such tile or no memory.
+ */
+Memimage*
+_memltile(Memlayer *l, Point p, int alloc)
+{
+	Memtile *t;
+	Rectangle r;
+	int n;
+
+	if(!l->saved)
+		return nil;
+	if(l->tile == nil){
+		if(!alloc)
+			return nil;
+		l->ntile = (Dx(l->screenr)+Tile-1)/Tile;
+		n = l->ntile*((Dy(l->screenr)+Tile-1)/Tile);
+		if((l->tile = mallocz(n*sizeof(Memtile), 1)) == nil)
+			return nil;
+	}
+	t = &l->tile[p.y/Tile*l->ntile + p.x/Tile];
+	if(t->i == nil && (t->z != nil || alloc)){
+		r = tilerect(l, p.x/Tile, p.y/Tile);
+		if((t->i = allocmemimage(r, l->screen->image->chan)) == nil)
+			return nil;
+		if(t->z != nil){
+			cloadmemimage(t->i, r, t->z, t->nz);
+			free(t->z);
+			t->z = nil;
+			t->nz = 0;
+		}else
+			_memlfill(t->i, r, l->saveval);
+	}
+	t->used = saveclock;
+	return t->i;
+}
+
+/*
+ * Call fn for the part of screenr in each tile of l's save area,
+ * with the tile, or nil if it has none yet.
+ */
+void
+_memlsaveop(
+	void (*fn)(Memimage*, Rectangle, Rectangle, void*, int),
+	Memlayer *l,
+	Rectangle screenr,
+	Rectangle clipr,
+	void *etc)
+{
+	Rectangle r, tr;
+	int x, y;
+
+	if(!l->saved){
+		fn(nil, screenr, clipr, etc, 1);
+		return;
+	}
+	r = rectsubpt(screenr, l->screenr.min);
+	if(!rectclip(&r, Rect(0, 0, Dx(l->screenr), Dy(l->screenr))))
+		return;
+	for(y=r.min.y/Tile; y*Tile<r.max.y; y++)
+		for(x=r.min.x/Tile; x*Tile<r.max.x; x++){
+			tr = tilerect(l, x, y);
+			rectclip(&tr, r);
+			fn(_memltile(l, tr.min, 0), rectaddpt(tr, l->screenr.min), clipr, etc, 1);
+		}
+}
+
+struct Read
+{
+	Memlayer	*l;
+	Memimage	*dst;
+};
+
+static void
+lreadop(Memimage *src, Rectangle screenr, Rectangle clipr, void *etc, int insave)
+{
+	struct Read *rd;
+	Rectangle r;
+	Point p;
+
+	USED(clipr.min.x);
+	rd = etc;
+	r = rectsubpt(screenr, rd->l->delta);
+	if(!insave)
+		p = screenr.min;
+	else if(src != nil)
+		p = subpt(screenr.min, rd->l->screenr.min);
+	else{
+		_memlfill(rd->dst, r, rd->l->saveval);
+		return;
+	}
+	memdraw(rd->dst, r, src, p, nil, p, S);
+}
+
+/*
+ * Copy r of layer i, in its own coordinates, into a new image.
+ * Nil if the layer has no save area or there is no memory.
+ */
+Memimage*
+_memlread(Memimage *i, Rectangle r)
+{
+	struct Read rd;
+	Memlayer *l;
+
+	l = i->layer;
+	if(!l->saved)
+		return nil;
+	rd.l = l;
+	rd.dst = allocmemimage(r, i->chan);
+	if(rd.dst == nil)
+		return nil;
+	r = rectaddpt(r, l->delta);
+	_memlayerop(lreadop, i, r, r, &rd);
+	return rd.dst;
+}
+
+static void
+freetile(Memtile *t)
+{
+	freememimage(t->i);
+	free(t->z);
+	memset(t, 0, sizeof *t);
+}
+
+/*
+ * Compress t if that saves at least half its size.
+ */
+static void
+ztile(Memtile *t)
+{
+	uchar *buf;
+	int n, m;
+
+	n = Dy(t->i->r)*bytesperline(t->i->r, t->i->depth);
+	if((buf = malloc(n/2)) == nil)
+		return;
+	m = cunloadmemimage(t->i, t->i->r, buf, n/2);
+	if(m < 0 || (t->z = realloc(buf, m)) == nil){
+		free(buf);
+		return;
+	}
+	t->nz = m;
+	freememimage(t->i);
+	t->i = nil;
+}
+
+static void
+trim(Memimage *i)
+{
+	Memlayer *l;
+	Memtile *t;
+	Rectangle r;
+	int k, n, lo, hi, m;
+
+	l = i->layer;
+	if(l->tile == nil)
+		return;
+	if(l->clear){
+		_memlfreesave(l);
+		return;
+	}
+	if(_memlvisible(i) < 0)
+		return;
+	n = l->ntile*((Dy(l->screenr)+Tile-1)/Tile);
+	for(k=0; k<n; k++){
+		t = &l->tile[k];
+		if(t->i == nil && t->z == nil)
+			continue;
+		r = rectaddpt(tilerect(l, k%l->ntile, k/l->ntile), l->screenr.min);
+		lo = 0;
+		hi = l->obs.nr;
+		while(lo < hi){
+			m = (lo+hi)/2;
+			if(l->obs.r[m].max.y <= r.min.y)
+				lo = m+1;
+			else
+				hi = m;
+		}
+		for(; lo<l->obs.nr && l->obs.r[lo].min.y<r.max.y; lo++)
+			if(rectXrect(l->obs.r[lo], r))
+				break;
+		if(lo == l->obs.nr || l->obs.r[lo].min.y >= r.max.y)
+			freetile(t);
+		else if(memlzsave > 0 && t->i != nil && saveclock-t->used >= memlzsave)
+			ztile(t);
+	}
+}
+
+/*
+ * Called after a shuffle: drop the tiles now entirely on
+ * the screen and compress those not used for a while.
+ */
+void
+_memltrimsave(Memscreen *s)
+{
+	Memimage *i;
+
+	saveclock++;
+	for(i=s->rearmost; i; i=i->layer->front)
+		trim(i);
+}
+
+void
+_memlfreesave(Memlayer *l)
+{
+	int k, n;
+
+	if(l->tile == nil)
+		return;
+	n = l->ntile*((Dy(l->screenr)+Tile-1)/Tile);
+	for(k=0; k<n; k++)
+		freetile(&l->tile[k]);
+	free(l->tile);
+	l->tile = nil;
+}
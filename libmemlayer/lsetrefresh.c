@@ -17,16 +17,15 @@ memlsetrefresh(Memimage *i, Refreshfn fn, void *ptr)
 	}
 
 	if(l->refreshfn == nil){	/* is using backup image; just free it */
-		freememimage(l->save);
-		l->save = nil;
+		_memlfreesave(l);
+		l->saved = 0;
 		l->refreshfn = fn;
 		l->refreshptr = ptr;
 		return 1;
 	}
 
-	l->save = allocmemimage(i->r, i->chan);
-	if(l->save == nil)
-		return 0;
+	l->saved = 1;
+	l->saveval = DNofill;
 	/* easiest way is just to update the entire save area */
 	l->refreshfn(i, i->r, l->refreshptr);
 	l->refreshfn = nil;
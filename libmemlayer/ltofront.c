@@ -22,7 +22,8 @@ _memltofront(Memimage *i, Memimage *front, int fill)
 	while(l->front != front){
 		f = l->front;
 		x = l->screenr;
-		overlap = rectclip(&x, f->layer->screenr);
+		/* inside memlbegin, memlcommit does the drawing */
+		overlap = s->trans == 0 && rectclip(&x, f->layer->screenr);
 		if(overlap){
 			memlhide(f, x);
 			f->layer->clear = 0;
@@ -42,6 +43,8 @@ _memltofront(Memimage *i, Memimage *front, int fill)
 		l->rear = f;
 		f->layer->front = i;
 		f->layer->rear = rr;
+		if(overlap)
+			_memlswapvis(i, f, x);
 		if(overlap && fill)
 			memlexpose(i, x);
 	}
@@ -18,7 +18,7 @@ _memltorear(Memimage *i, Memimage *rear)
 	while(l->rear != rear){
 		r = l->rear;
 		x = l->screenr;
-		overlap = rectclip(&x, r->layer->screenr);
+		overlap = s->trans == 0 && rectclip(&x, r->layer->screenr);
 		if(overlap){
 			memlhide(i, x);
 			l->clear = 0;
@@ -38,8 +38,10 @@ _memltorear(Memimage *i, Memimage *rear)
 		l->front = r;
 		r->layer->rear = i;
 		r->layer->front = f;
-		if(overlap)
+		if(overlap){
+			_memlswapvis(r, i, x);
 			memlexpose(r, x);
+		}
 	}
 }
 
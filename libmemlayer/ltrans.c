@@ -0,0 +1,305 @@
+#include <u.h>
+#include <libc.h>
+#include <draw.h>
+#include <memdraw.h>
+#include <memlayer.h>
+
+/*
+ * Between memlbegin and memlcommit, memltofront, memltorear and
+ * memlorigin only rearrange the screen's list and move layers;
+ * nothing is drawn.  memlcommit then compares what each layer
+ * showed at memlbegin with what it shows now and does the least
+ * drawing to get there: it saves the parts going out of sight,
+ * copies a single moved layer across the screen, exposes the parts
+ * coming into sight and repaints the uncovered background, each
+ * once however many steps led there, and calls fn with each part
+ * of the screen it drew.  No other memlayer function may be called
+ * on the screen in between.
+ */
+
+struct Touch
+{
+	void	(*fn)(Rectangle, void*);
+	void	*etc;
+};
+
+struct Save
+{
+	Memlayer	*l;
+	Point		d;	/* from new screen position to old */
+};
+
+static int
+regcopy(Memregion *g, Memregion *f)
+{
+	return _memlregion(g, f->r, f->nr);
+}
+
+/*
+ * Remove all of f, moved by d, from g.
+ */
+static int
+regsubreg(Memregion *g, Memregion *f, Point d)
+{
+	int i;
+
+	for(i=0; i<f->nr && g->nr>0; i++)
+		if(_memlregsub(g, rectaddpt(f->r[i], d)) < 0)
+			return -1;
+	return 0;
+}
+
+/*
+ * Make g the part of f also in h moved by d.
+ */
+static int
+regand(Memregion *g, Memregion *f, Memregion *h, Point d)
+{
+	Rectangle *r, x;
+	int i, j, n;
+
+	r = malloc((f->nr*h->nr+1)*sizeof(Rectangle));
+	if(r == nil)
+		return -1;
+	n = 0;
+	for(i=0; i<f->nr; i++)
+		for(j=0; j<h->nr; j++){
+			x = rectaddpt(h->r[j], d);
+			if(rectclip(&x, f->r[i]))
+				r[n++] = x;
+		}
+	i = _memlregion(g, r, n);
+	free(r);
+	return i;
+}
+
+int
+memlbegin(Memscreen *s)
+{
+	Memimage *i;
+	Memlayer *l;
+
+	if(s->trans > 0){
+		s->trans++;
+		return 0;
+	}
+	for(i=s->rearmost; i; i=l->front){
+		l = i->layer;
+		if(_memlvisible(i) < 0 || regcopy(&l->tvis, &l->vis) < 0)
+			return -1;
+		l->tscreenr = l->screenr;
+	}
+	s->trans = 1;
+	return 0;
+}
+
+static void
+savetile(Memimage *dst, Rectangle screenr, Rectangle clipr, void *etc, int insave)
+{
+	struct Save *sv;
+	Rectangle r;
+
+	USED(clipr.min.x);
+	USED(insave);
+	sv = etc;
+	r = rectsubpt(screenr, sv->l->screenr.min);
+	if(dst == nil && (dst = _memltile(sv->l, r.min, 1)) == nil)
+		return;
+	memdraw(dst, r, sv->l->screen->image, addpt(screenr.min, sv->d), nil, ZP, S);
+}
+
+/*
+ * Copy r of the screen, where l was at memlbegin, to l's save area.
+ */
+static void
+save(Memlayer *l, Rectangle r)
+{
+	struct Save sv;
+
+	sv.l = l;
+	sv.d = subpt(l->tscreenr.min, l->screenr.min);
+	r = rectsubpt(r, sv.d);
+	_memlsaveop(savetile, l, r, r, &sv);
+}
+
+static void
+touch(struct Touch *t, Rectangle r)
+{
+	if(t->fn != nil)
+		t->fn(r, t->etc);
+}
+
+static void
+copyband(Memimage *dst, Rectangle *r, int n, Point d)
+{
+	Rectangle x;
+	int i;
+
+	for(i=0; i<n; i++){
+		x = d.x > 0 ? r[n-1-i] : r[i];
+		memdraw(dst, x, dst, subpt(x.min, d), nil, ZP, S);
+	}
+}
+
+/*
+ * Copy each piece of g from where it is moved back by d, band by
+ * band, in an order that reads each piece before it is written over.
+ */
+static void
+copy(Memimage *dst, Memregion *g, Point d)
+{
+	int b, e;
+
+	if(d.y > 0)
+		for(e=g->nr; e>0; e=b){
+			for(b=e-1; b>0 && g->r[b-1].min.y==g->r[e-1].min.y; b--)
+				;
+			copyband(dst, g->r+b, e-b, d);
+		}
+	else
+		for(b=0; b<g->nr; b=e){
+			for(e=b+1; e<g->nr && g->r[e].min.y==g->r[b].min.y; e++)
+				;
+			copyband(dst, g->r+b, e-b, d);
+		}
+}
+
+/*
+ * Paint the parts of r not under any layer from i forward.
+ */
+static void
+fillbg(Memscreen *s, Memimage *i, Rectangle r, struct Touch *t)
+{
+	Rectangle fr;
+
+	while(i != nil && !rectXrect(r, i->layer->screenr))
+		i = i->layer->front;
+	if(i == nil){
+		if(s->fill)
+			memdraw(s->image, r, s->fill, r.min, nil, r.min, S);
+		touch(t, r);
+		return;
+	}
+	fr = i->layer->screenr;
+	i = i->layer->front;
+	if(r.min.y < fr.min.y){
+		fillbg(s, i, Rect(r.min.x, r.min.y, r.max.x, fr.min.y), t);
+		r.min.y = fr.min.y;
+	}
+	if(r.max.y > fr.max.y){
+		fillbg(s, i, Rect(r.min.x, fr.max.y, r.max.x, r.max.y), t);
+		r.max.y = fr.max.y;
+	}
+	if(r.min.x < fr.min.x)
+		fillbg(s, i, Rect(r.min.x, r.min.y, fr.min.x, r.max.y), t);
+	if(r.max.x > fr.max.x)
+		fillbg(s, i, Rect(fr.max.x, r.min.y, r.max.x, r.max.y), t);
+}
+
+/*
+ * Work out what of i to copy (if it is mv) and expose, and save
+ * what is going out of sight.  Nothing on the screen has changed
+ * yet.  If there is no memory for the regions, save all that was
+ * on the screen and set texp.nr < 0 to expose all that is.
+ */
+static void
+plan(Memimage *i, Memimage **mv, Memregion *mvp, Memregion *h)
+{
+	Memlayer *l;
+	Point d;
+	int k, ok;
+
+	l = i->layer;
+	d = subpt(l->screenr.min, l->tscreenr.min);
+	ok = _memlvisible(i) == 0 && regcopy(&l->texp, &l->vis) == 0;
+	if(ok && eqpt(d, ZP)){
+		/* what stays on the screen stays put */
+		ok = regsubreg(&l->texp, &l->tvis, ZP) == 0;
+		if(ok && l->saved && regcopy(h, &l->tvis) == 0 && regsubreg(h, &l->vis, ZP) == 0){
+			for(k=0; k<h->nr; k++)
+				save(l, h->r[k]);
+			return;
+		}
+	}else if(ok && i == *mv){
+		/* what was on the screen and still is can be copied */
+		ok = regand(mvp, &l->vis, &l->tvis, d) == 0 && regsubreg(&l->texp, mvp, ZP) == 0;
+		if(!ok)
+			*mv = nil;
+		else if(l->saved && regcopy(h, &l->tvis) == 0 && regsubreg(h, mvp, mulpt(d, -1)) == 0){
+			for(k=0; k<h->nr; k++)
+				save(l, h->r[k]);
+			return;
+		}
+	}
+	if(!ok)
+		l->texp.nr = -1;
+	if(l->saved)
+		for(k=0; k<l->tvis.nr; k++)
+			save(l, l->tvis.r[k]);
+}
+
+/*
+ * Draw the changes since memlbegin, calling fn(r, etc) for each
+ * rectangle r of the screen drawn.
+ */
+void
+memlcommit(Memscreen *s, void (*fn)(Rectangle, void*), void *etc)
+{
+	Memimage *i, *mv;
+	Memlayer *l;
+	Memregion mvp, h;
+	struct Touch t;
+	int k, n;
+
+	if(s->trans == 0 || --s->trans > 0)
+		return;
+	t.fn = fn;
+	t.etc = etc;
+
+	/* one moved layer can be copied across the screen directly */
+	n = 0;
+	mv = nil;
+	for(i=s->rearmost; i; i=l->front){
+		l = i->layer;
+		if(!eqpt(l->screenr.min, l->tscreenr.min)){
+			n++;
+			mv = i;
+		}
+		l->clear = 0;
+		_memlinvalvis(i);
+	}
+	if(n != 1)
+		mv = nil;
+
+	memset(&mvp, 0, sizeof mvp);
+	memset(&h, 0, sizeof h);
+	for(i=s->rearmost; i; i=i->layer->front)
+		plan(i, &mv, &mvp, &h);
+	if(mv != nil){
+		copy(s->image, &mvp, subpt(mv->layer->screenr.min, mv->layer->tscreenr.min));
+		for(k=0; k<mvp.nr; k++)
+			touch(&t, mvp.r[k]);
+	}
+	for(i=s->rearmost; i; i=i->layer->front){
+		l = i->layer;
+		if(l->texp.nr < 0){
+			memlexpose(i, l->screenr);
+			touch(&t, l->screenr);
+		}
+		for(k=0; k<l->texp.nr; k++){
+			memlexpose(i, l->texp.r[k]);
+			touch(&t, l->texp.r[k]);
+		}
+		l->texp.nr = 0;
+	}
+	/* repaint what was covered and is not now */
+	for(i=s->rearmost; i; i=i->layer->front){
+		l = i->layer;
+		for(k=0; k<l->tvis.nr; k++)
+			fillbg(s, s->rearmost, l->tvis.r[k], &t);
+		l->tvis.nr = 0;
+	}
+	free(mvp.r);
+	free(h.r);
+	_memlsetclear(s);
+}
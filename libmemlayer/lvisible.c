@@ -0,0 +1,320 @@
+#include <u.h>
+#include <libc.h>
+#include <draw.h>
+#include <memdraw.h>
+#include <memlayer.h>
+
+/*
+ * Each layer remembers which parts of it are on the screen (vis)
+ * and which are in the save area (obs), so _memlayerop can hand
+ * out the pieces directly instead of splitting against every
+ * window in front.  vis is made from scratch only when a layer
+ * is new or has moved; when two overlapping neighbours trade
+ * places, _memlswapvis moves the pieces of the overlap from one
+ * to the other.  obs is made from vis when it is next needed.
+ */
+
+static int
+grow(Memregion *g, int n)
+{
+	Rectangle *r;
+
+	if(n <= g->nalloc)
+		return 0;
+	n += n/2 + 8;
+	r = realloc(g->r, n*sizeof(Rectangle));
+	if(r == nil)
+		return -1;
+	g->r = r;
+	g->nalloc = n;
+	return 0;
+}
+
+static int
+add(Memregion *g, Rectangle r)
+{
+	if(grow(g, g->nr+1) < 0)
+		return -1;
+	g->r[g->nr++] = r;
+	return 0;
+}
+
+static int
+intcmp(const void *a, const void *b)
+{
+	return *(int*)a - *(int*)b;
+}
+
+static int
+xcmp(const void *a, const void *b)
+{
+	return ((Rectangle*)a)->min.x - ((Rectangle*)b)->min.x;
+}
+
+/*
+ * Make g the banded form of the n disjoint rectangles in.
+ */
+static int
+band(Memregion *g, Rectangle *in, int n)
+{
+	int *y, ny, j, k, m, y0, y1, start, nb, pb, pnb;
+	Rectangle *r;
+
+	g->nr = 0;
+	if(n == 0)
+		return 0;
+	y = malloc(2*n*sizeof(int));
+	if(y == nil)
+		return -1;
+	for(j=0; j<n; j++){
+		y[2*j] = in[j].min.y;
+		y[2*j+1] = in[j].max.y;
+	}
+	qsort(y, 2*n, sizeof(int), intcmp);
+	for(ny=1, j=1; j<2*n; j++)
+		if(y[j] != y[ny-1])
+			y[ny++] = y[j];
+
+	pb = -1;
+	pnb = 0;
+	for(k=0; k+1<ny; k++){
+		y0 = y[k];
+		y1 = y[k+1];
+		start = g->nr;
+		for(j=0; j<n; j++)
+			if(in[j].min.y <= y0 && in[j].max.y >= y1)
+			if(add(g, Rect(in[j].min.x, y0, in[j].max.x, y1)) < 0){
+				free(y);
+				return -1;
+			}
+		if(g->nr == start){
+			pb = -1;
+			continue;
+		}
+		r = g->r+start;
+		qsort(r, g->nr-start, sizeof(Rectangle), xcmp);
+		for(m=0, j=1; j<g->nr-start; j++)
+			if(r[j].min.x == r[m].max.x)
+				r[m].max.x = r[j].max.x;
+			else
+				r[++m] = r[j];
+		nb = m+1;
+		g->nr = start+nb;
+
+		/* extend the band above if it has the same spans */
+		if(pb >= 0 && pnb == nb && g->r[pb].max.y == y0){
+			for(j=0; j<nb; j++)
+				if(g->r[pb+j].min.x != r[j].min.x || g->r[pb+j].max.x != r[j].max.x)
+					break;
+			if(j == nb){
+				for(j=0; j<nb; j++)
+					g->r[pb+j].max.y = y1;
+				g->nr = start;
+				continue;
+			}
+		}
+		pb = start;
+		pnb = nb;
+	}
+	free(y);
+	return 0;
+}
+
+/*
+ * Remove s from g.
+ */
+static int
+regsub(Memregion *g, Rectangle s)
+{
+	Memregion t;
+	Rectangle r;
+	int i, n;
+
+	memset(&t, 0, sizeof t);
+	for(i=0; i<g->nr; i++){
+		r = g->r[i];
+		if(!rectXrect(r, s)){
+			n = add(&t, r);
+		}else{
+			n = 0;
+			if(r.min.y < s.min.y)
+				n |= add(&t, Rect(r.min.x, r.min.y, r.max.x, s.min.y));
+			if(s.max.y < r.max.y)
+				n |= add(&t, Rect(r.min.x, s.max.y, r.max.x, r.max.y));
+			if(r.min.y < s.min.y)
+				r.min.y = s.min.y;
+			if(s.max.y < r.max.y)
+				r.max.y = s.max.y;
+			if(r.min.x < s.min.x)
+				n |= add(&t, Rect(r.min.x, r.min.y, s.min.x, r.max.y));
+			if(s.max.x < r.max.x)
+				n |= add(&t, Rect(s.max.x, r.min.y, r.max.x, r.max.y));
+		}
+		if(n < 0){
+			free(t.r);
+			return -1;
+		}
+	}
+	n = band(g, t.r, t.nr);
+	free(t.r);
+	return n;
+}
+
+/*
+ * Make obs the part of r not in vis.
+ */
+static int
+complement(Memregion *obs, Memregion *vis, Rectangle r)
+{
+	Memregion t;
+	Rectangle *v;
+	int i, j, y, x, n;
+
+	memset(&t, 0, sizeof t);
+	n = 0;
+	y = r.min.y;
+	for(i=0; i<vis->nr; i=j){
+		v = vis->r+i;
+		if(y < v->min.y)
+			n |= add(&t, Rect(r.min.x, y, r.max.x, v->min.y));
+		x = r.min.x;
+		for(j=i; j<vis->nr && vis->r[j].min.y == v->min.y; j++){
+			if(x < vis->r[j].min.x)
+				n |= add(&t, Rect(x, v->min.y, vis->r[j].min.x, v->max.y));
+			x = vis->r[j].max.x;
+		}
+		if(x < r.max.x)
+			n |= add(&t, Rect(x, v->min.y, r.max.x, v->max.y));
+		y = v->max.y;
+	}
+	if(y < r.max.y)
+		n |= add(&t, Rect(r.min.x, y, r.max.x, r.max.y));
+	if(n == 0)
+		n = band(obs, t.r, t.nr);
+	free(t.r);
+	return n;
+}
+
+static int
+visvalid(Memlayer *l)
+{
+	return l->visok && eqrect(l->visscr, l->screen->image->clipr);
+}
+
+/*
+ * Bring i's vis and obs up to date.
+ */
+int
+_memlvisible(Memimage *i)
+{
+	Memlayer *l;
+	Memimage *f;
+	Rectangle r;
+
+	l = i->layer;
+	if(!visvalid(l)){
+		l->obsok = 0;
+		l->visok = 0;
+		l->visscr = l->screen->image->clipr;
+		l->vis.nr = 0;
+		r = l->screenr;
+		if(rectclip(&r, l->visscr)){
+			if(add(&l->vis, r) < 0)
+				return -1;
+			for(f=l->front; f!=nil && l->vis.nr>0; f=f->layer->front)
+				if(rectXrect(r, f->layer->screenr))
+				if(regsub(&l->vis, f->layer->screenr) < 0)
+					return -1;
+		}
+		l->visok = 1;
+	}
+	if(!l->obsok){
+		if(complement(&l->obs, &l->vis, l->screenr) < 0)
+			return -1;
+		l->obsok = 1;
+	}
+	return 0;
+}
+
+/*
+ * front has just moved in front of its neighbour back;
+ * x is where they overlap.
+ */
+void
+_memlswapvis(Memimage *front, Memimage *back, Rectangle x)
+{
+	Memlayer *fl, *bl;
+	Memregion t;
+	Rectangle r;
+	int i, n;
+
+	fl = front->layer;
+	bl = back->layer;
+	fl->obsok = 0;
+	bl->obsok = 0;
+	if(!visvalid(bl)){
+		fl->visok = 0;
+		bl->visok = 0;
+		return;
+	}
+	if(visvalid(fl)){
+		memset(&t, 0, sizeof t);
+		n = grow(&t, fl->vis.nr+bl->vis.nr);
+		if(n == 0){
+			memmove(t.r, fl->vis.r, fl->vis.nr*sizeof(Rectangle));
+			t.nr = fl->vis.nr;
+			for(i=0; i<bl->vis.nr; i++){
+				r = bl->vis.r[i];
+				if(rectclip(&r, x))
+					t.r[t.nr++] = r;
+			}
+			n = band(&fl->vis, t.r, t.nr);
+		}
+		free(t.r);
+		if(n < 0)
+			fl->visok = 0;
+	}
+	if(regsub(&bl->vis, x) < 0)
+		bl->visok = 0;
+}
+
+void
+_memlinvalvis(Memimage *i)
+{
+	i->layer->visok = 0;
+	i->layer->obsok = 0;
+}
+
+void
+_memlfreevis(Memlayer *l)
+{
+	free(l->vis.r);
+	free(l->obs.r);
+	free(l->tvis.r);
+	free(l->texp.r);
+	memset(&l->vis, 0, sizeof l->vis);
+	memset(&l->obs, 0, sizeof l->obs);
+	memset(&l->tvis, 0, sizeof l->tvis);
+	memset(&l->texp, 0, sizeof l->texp);
+	l->visok = 0;
+	l->obsok = 0;
+}
+
+/*
+ * Make g the banded form of the n disjoint rectangles r,
+ * which must not be g's own.
+ */
+int
+_memlregion(Memregion *g, Rectangle *r, int n)
+{
+	return band(g, r, n);
+}
+
+/*
+ * Remove r from g.
+ */
+int
+_memlregsub(Memregion *g, Rectangle r)
+{
+	return regsub(g, r);
+}
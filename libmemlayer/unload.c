@@ -34,18 +34,15 @@ memunload(Memimage *src, Rectangle r, uchar *data, int n)
 	/*
 	 * src is an obscured layer or data is unaligned
 	 */
-	if(dl->save && dx==0){
-		if(dl->refreshfn != nil)
-			return -1;	/* can't unload window if it's not Refbackup */
-		if(n > 0)
-			memlhide(src, r);
-		n = unloadmemimage(dl->save, lr, data, n);
-		return n;
+	if(dl->saved)
+		tmp = _memlread(src, lr);
+	else{
+		tmp = allocmemimage(lr, src->chan);
+		if(tmp != nil)
+			memdraw(tmp, lr, src, lr.min, nil, lr.min, S);
 	}
-	tmp = allocmemimage(lr, src->chan);
 	if(tmp == nil)
 		return -1;
-	memdraw(tmp, lr, src, lr.min, nil, lr.min, S);
 	n = unloadmemimage(tmp, lr, data, n);
 	freememimage(tmp);
 	return n;